@@ -0,0 +1,109 @@
+#ifndef _RIO_ASYNC_FILE_HPP
+#define _RIO_ASYNC_FILE_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "rio/blocking_io_pool.hpp"
+#include "rio/task.hpp"
+
+namespace rio {
+
+// A regular file whose I/O runs on the loop's blocking I/O pool, since epoll
+// can't tell when a disk read would block.
+class async_file {
+    class awaiter {
+    public:
+        awaiter(blocking_io_pool& pool, blocking_io_pool::request req,
+                const char* what = "async_file") noexcept
+            : pool_(pool), req_(req), what_(what) { }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> coro) {
+            req_.coro = coro;
+            pool_.submit(req_);
+        }
+
+        // Throws std::system_error if the operation failed.
+        std::size_t await_resume() const;
+    private:
+        blocking_io_pool& pool_;
+        blocking_io_pool::request req_;
+        const char* what_;
+    };
+
+public:
+    async_file() noexcept
+        : fd_(-1), pool_(nullptr) { }
+
+    // Takes ownership of `fd`, using the current event loop's I/O pool.
+    explicit async_file(int fd);
+
+    // Opens `path` on the I/O pool, see open(2). `path` must stay valid
+    // until it completes.
+    static task<async_file> open(const char* path, int flags, mode_t mode = 0644);
+
+    ~async_file();
+
+    async_file(async_file const&) = delete;
+    async_file& operator=(async_file const&) = delete;
+
+    async_file(async_file&& other) noexcept;
+    async_file& operator=(async_file&& other) noexcept;
+
+    int fd() const noexcept {
+        return fd_;
+    }
+
+    bool is_open() const noexcept {
+        return fd_ != -1;
+    }
+
+    void close() noexcept;
+
+    // Operations throw std::system_error (EBADF) on a file that was never
+    // opened.
+
+    // Returns the number of bytes read, 0 at end of file.
+    awaiter async_pread(void* buf, std::size_t len, off_t offset) {
+        return make_awaiter(blocking_io_pool::op::read, buf, len, offset);
+    }
+
+    // Returns the number of bytes written.
+    awaiter async_pwrite(void const* buf, std::size_t len, off_t offset) {
+        return make_awaiter(blocking_io_pool::op::write, const_cast<void*>(buf), len, offset);
+    }
+
+    awaiter async_fsync() {
+        return make_awaiter(blocking_io_pool::op::fsync);
+    }
+
+    awaiter async_fdatasync() {
+        return make_awaiter(blocking_io_pool::op::fdatasync);
+    }
+
+    // Access pattern hint for [offset, offset + len), see posix_fadvise(2).
+    awaiter async_fadvise(off_t offset, std::size_t len, int advice) {
+        return make_awaiter(blocking_io_pool::op::fadvise, nullptr, len, offset, advice);
+    }
+
+    // Starts reading [offset, offset + len) into the page cache, see readahead(2).
+    awaiter async_readahead(off_t offset, std::size_t len) {
+        return make_awaiter(blocking_io_pool::op::readahead, nullptr, len, offset);
+    }
+
+private:
+    awaiter make_awaiter(blocking_io_pool::op type, void* buf = nullptr,
+                         std::size_t len = 0, off_t offset = 0, int advice = 0);
+
+    int fd_;
+    blocking_io_pool* pool_;
+};
+
+}
+
+#endif // _RIO_ASYNC_FILE_HPP
@@ -0,0 +1,245 @@
+#ifndef _RIO_ASYNC_GENERATOR_HPP
+#define _RIO_ASYNC_GENERATOR_HPP
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "tsl/macros.hpp"
+#include "rio/common/broken_promise.hpp"
+
+namespace rio::impl_async_generator {
+
+using std::coroutine_handle;
+
+template<typename T>
+class async_generator;
+
+template<typename T>
+class async_generator_iterator;
+
+// Control moves between the generator and its consumer by symmetric transfer,
+// like task_promise_base::final_awaitable: co_yield resumes whoever is waiting
+// on begin() or operator++, and the generator only runs while awaited.
+template<typename T>
+class async_generator_promise {
+    using value_type = std::remove_reference_t<T>;
+
+    struct yield_awaitable {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        coroutine_handle<> await_suspend(coroutine_handle<async_generator_promise> coro) const noexcept {
+            return coro.promise().consumer_;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+public:
+    async_generator_promise() noexcept {}
+
+    async_generator<T> get_return_object() noexcept;
+
+    auto initial_suspend() const noexcept {
+        return std::suspend_always {};
+    }
+
+    auto final_suspend() const noexcept {
+        return yield_awaitable {};
+    }
+
+    // The yielded value lives in the generator's frame until it is resumed,
+    // so it is handed out by reference, without copies or allocations.
+    yield_awaitable yield_value(value_type& value) noexcept {
+        value_ = std::addressof(value);
+        return {};
+    }
+
+    yield_awaitable yield_value(value_type&& value) noexcept {
+        value_ = std::addressof(value);
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        exception_ = std::current_exception();
+    }
+
+    void return_void() noexcept {
+        value_ = nullptr;
+    }
+
+    // Rethrows an exception thrown by the generator body, if any.
+    void rethrow_if_exception() {
+        if (exception_)
+            std::rethrow_exception(std::exchange(exception_, nullptr));
+    }
+
+    value_type& value() const noexcept {
+        TSL_ASSERT(value_ != nullptr);
+        return *value_;
+    }
+
+private:
+    template<typename U>
+    friend class async_generator_iterator;
+
+    value_type* value_ = nullptr;
+    std::exception_ptr exception_;
+    coroutine_handle<> consumer_;
+};
+
+template<typename T>
+class async_generator_iterator {
+    using promise_type = async_generator_promise<T>;
+    using handle_type = coroutine_handle<promise_type>;
+
+    struct advance_awaitable {
+        handle_type coroutine_;
+
+        bool await_ready() const noexcept {
+            return !coroutine_ || coroutine_.done();
+        }
+
+        coroutine_handle<> await_suspend(coroutine_handle<> coro) noexcept {
+            coroutine_.promise().consumer_ = coro;
+            return coroutine_;
+        }
+    };
+
+public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::remove_cvref_t<T>;
+    using reference = std::remove_reference_t<T>&;
+    using pointer = std::remove_reference_t<T>*;
+
+    async_generator_iterator() noexcept
+        : coroutine_(nullptr) { }
+
+    explicit async_generator_iterator(handle_type coroutine) noexcept
+        : coroutine_(coroutine) { }
+
+    // Resumes the generator until its next co_yield (or its end).
+    auto operator++() noexcept {
+        struct awaitable : advance_awaitable {
+            async_generator_iterator& it_;
+
+            async_generator_iterator& await_resume() {
+                if (it_.coroutine_.done()) {
+                    auto coro = std::exchange(it_.coroutine_, nullptr);
+                    coro.promise().rethrow_if_exception();
+                }
+                return it_;
+            }
+        };
+
+        return awaitable { { coroutine_ }, *this };
+    }
+
+    reference operator*() const noexcept {
+        return coroutine_.promise().value();
+    }
+
+    pointer operator->() const noexcept {
+        return std::addressof(operator*());
+    }
+
+    bool operator==(async_generator_iterator const& other) const noexcept {
+        return coroutine_ == other.coroutine_;
+    }
+
+private:
+    template<typename U>
+    friend class async_generator;
+
+    handle_type coroutine_;
+};
+
+// A coroutine that produces a stream of values with co_yield, and may
+// co_await in between. Iterate it with:
+//
+//     for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it)
+//         use(*it);
+template<typename T>
+class [[nodiscard]] async_generator {
+public:
+    using promise_type = async_generator_promise<T>;
+    using iterator = async_generator_iterator<T>;
+
+    async_generator() noexcept
+        : coroutine_(nullptr) { }
+
+    explicit async_generator(coroutine_handle<promise_type> coroutine) noexcept
+        : coroutine_(coroutine) { }
+
+    ~async_generator() {
+        if (coroutine_)
+            coroutine_.destroy();
+    }
+
+    async_generator(async_generator const&) = delete;
+    async_generator& operator=(async_generator const&) = delete;
+
+    async_generator(async_generator&& other) noexcept
+        : coroutine_(other.coroutine_)
+    {
+        other.coroutine_ = nullptr;
+    }
+
+    async_generator& operator=(async_generator&& other) noexcept {
+        if (std::addressof(other) != this) {
+            if (coroutine_)
+                coroutine_.destroy();
+
+            coroutine_ = other.coroutine_;
+            other.coroutine_ = nullptr;
+        }
+
+        return *this;
+    }
+
+    // Starts the generator, resuming with an iterator to its first value.
+    auto begin() noexcept {
+        struct awaitable : iterator::advance_awaitable {
+            iterator await_resume() {
+                if (!this->coroutine_)
+                    throw broken_promise {};
+
+                if (this->coroutine_.done()) {
+                    this->coroutine_.promise().rethrow_if_exception();
+                    return iterator {};
+                }
+                return iterator { this->coroutine_ };
+            }
+        };
+
+        return awaitable { { coroutine_ } };
+    }
+
+    iterator end() noexcept {
+        return iterator {};
+    }
+
+private:
+    coroutine_handle<promise_type> coroutine_;
+};
+
+template<typename T>
+async_generator<T> async_generator_promise<T>::get_return_object() noexcept {
+    return async_generator<T> { coroutine_handle<async_generator_promise>::from_promise(*this) };
+}
+
+}
+
+// Export
+namespace rio {
+
+using impl_async_generator::async_generator;
+
+}
+
+#endif // _RIO_ASYNC_GENERATOR_HPP
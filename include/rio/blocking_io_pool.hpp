@@ -0,0 +1,102 @@
+#ifndef _RIO_BLOCKING_IO_POOL_HPP
+#define _RIO_BLOCKING_IO_POOL_HPP
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+#include "rio/selector.hpp"
+
+namespace rio {
+
+class event_loop_t;
+
+// A bounded pool of threads running blocking syscalls (regular-file I/O,
+// fsync, ...) on behalf of an event loop. Completions are handed back to the
+// loop thread through an eventfd registered in its selector, and the waiting
+// coroutines are resumed from there.
+//
+// Requests are intrusive and usually live in an awaiter, so submitting one
+// doesn't allocate. Queued reads (or writes) on the same fd that continue
+// each other are merged into a single preadv (pwritev). Requests still queued
+// when the pool is destroyed complete with ECANCELED.
+class blocking_io_pool {
+public:
+    enum class op : std::uint8_t {
+        read,
+        write,
+        fsync,
+        fdatasync,
+        fadvise,
+        readahead,
+        open
+    };
+
+    struct request {
+        op type;
+        int fd;
+        void* buf = nullptr;
+        std::size_t len = 0;
+        off_t offset = 0;
+        int advice = 0;
+        // open: `buf` is the path, and the result the new fd.
+        int flags = 0;
+        mode_t mode = 0;
+
+        // Filled by the pool: the syscall's result, or -1 and an errno.
+        ssize_t result = 0;
+        int error = 0;
+
+        std::coroutine_handle<> coro;
+        request* next = nullptr;
+    };
+
+    explicit blocking_io_pool(event_loop_t& loop, std::size_t max_threads = 4);
+    ~blocking_io_pool();
+
+    blocking_io_pool(blocking_io_pool const&) = delete;
+    blocking_io_pool& operator=(blocking_io_pool const&) = delete;
+
+    // Threads are started on demand, up to this limit.
+    void set_max_threads(std::size_t max_threads);
+
+    std::size_t max_threads() const noexcept {
+        return max_threads_;
+    }
+
+    // Queues `req`; `req.coro` is resumed on the loop thread once it completes.
+    // Must be called from the loop thread, and `req` must stay alive until then.
+    void submit(request& req);
+
+private:
+    static void on_completion(void* ctx, selector::events ev);
+    void start_thread();
+    void worker();
+    void execute(request* batch);
+    void complete(request* batch);
+    void resume_completed();
+
+    event_loop_t& loop_;
+    int efd_;
+    std::size_t max_threads_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<request*> queue_;
+    std::vector<std::thread> threads_;
+    std::size_t idle_threads_ = 0;
+    bool stop_ = false;
+
+    std::mutex done_mutex_;
+    request* done_head_ = nullptr;
+    request* done_tail_ = nullptr;
+};
+
+}
+
+#endif // _RIO_BLOCKING_IO_POOL_HPP
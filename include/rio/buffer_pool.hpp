@@ -0,0 +1,149 @@
+#ifndef _RIO_BUFFER_POOL_HPP
+#define _RIO_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <span>
+#include <utility>
+#include "rio/task.hpp"
+
+namespace rio {
+
+class buffer_pool;
+
+// A buffer taken from a buffer_pool, given back when the lease is released
+// or destroyed. Must not outlive its pool.
+class buffer_lease {
+public:
+    buffer_lease() noexcept = default;
+
+    ~buffer_lease() {
+        release();
+    }
+
+    buffer_lease(buffer_lease const&) = delete;
+    buffer_lease& operator=(buffer_lease const&) = delete;
+
+    buffer_lease(buffer_lease&& other) noexcept
+        : pool_(std::exchange(other.pool_, nullptr)),
+          buffer_(std::exchange(other.buffer_, nullptr)),
+          size_(std::exchange(other.size_, 0)) { }
+
+    buffer_lease& operator=(buffer_lease&& other) noexcept {
+        if (this != &other) {
+            release();
+            pool_ = std::exchange(other.pool_, nullptr);
+            buffer_ = std::exchange(other.buffer_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    // The bytes held: what async_read_pooled received, or the whole buffer
+    // for a lease from buffer_pool::acquire().
+    std::span<std::byte> data() const noexcept {
+        return { buffer_, size_ };
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    // Whether the lease holds a buffer at all.
+    explicit operator bool() const noexcept {
+        return buffer_ != nullptr;
+    }
+
+    // Shrinks data() to its first `n` bytes.
+    void truncate(std::size_t n) noexcept {
+        if (n < size_)
+            size_ = n;
+    }
+
+    void release() noexcept;
+
+private:
+    friend class buffer_pool;
+
+    buffer_lease(buffer_pool* pool, std::byte* buffer, std::size_t size) noexcept
+        : pool_(pool), buffer_(buffer), size_(size) { }
+
+    buffer_pool* pool_ = nullptr;
+    std::byte* buffer_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Fixed-size buffers shared by many connections, so a connection only holds
+// one while it has data to process and an idle one holds none.
+//
+// Released buffers are kept on an intrusive free list, up to `max_free` of
+// them, so steady traffic recycles them without allocating. Not thread-safe:
+// it belongs to a loop, like event_loop_t::buffers().
+class buffer_pool {
+public:
+    static constexpr std::size_t default_buffer_size = 16 * 1024;
+    static constexpr std::size_t default_max_free = 1024;
+
+    explicit buffer_pool(std::size_t buffer_size = default_buffer_size,
+                         std::size_t max_free = default_max_free);
+    ~buffer_pool();
+
+    buffer_pool(buffer_pool const&) = delete;
+    buffer_pool& operator=(buffer_pool const&) = delete;
+
+    buffer_lease acquire();
+
+    std::size_t buffer_size() const noexcept {
+        return buffer_size_;
+    }
+
+    // Buffers lent out right now, and kept on the free list.
+    std::size_t leased() const noexcept {
+        return leased_;
+    }
+
+    std::size_t free() const noexcept {
+        return num_free_;
+    }
+
+    void set_max_free(std::size_t max_free) noexcept;
+
+    // Frees every buffer on the free list.
+    void trim() noexcept;
+
+private:
+    friend class buffer_lease;
+
+    struct free_buffer {
+        free_buffer* next;
+    };
+
+    void give_back(std::byte* buffer) noexcept;
+
+    std::size_t buffer_size_;
+    std::size_t max_free_;
+    free_buffer* free_ = nullptr;
+    std::size_t num_free_ = 0;
+    std::size_t leased_ = 0;
+};
+
+inline void buffer_lease::release() noexcept {
+    if (buffer_) {
+        pool_->give_back(buffer_);
+        pool_ = nullptr;
+        buffer_ = nullptr;
+        size_ = 0;
+    }
+}
+
+// Reads from a non-blocking fd registered in the event loop as readable, but
+// only takes a buffer from `pool` once the fd is readable: while it waits, the
+// caller holds no memory. Completes with at most one buffer's worth of data,
+// or an empty lease (holding no buffer) at end of file.
+task<buffer_lease> async_read_pooled(int fd, buffer_pool& pool);
+
+// Same, with the current loop's pool.
+task<buffer_lease> async_read_pooled(int fd);
+
+}
+
+#endif // _RIO_BUFFER_POOL_HPP
@@ -0,0 +1,35 @@
+#ifndef _RIO_COMMON_ERRC_HPP
+#define _RIO_COMMON_ERRC_HPP
+
+#include <expected>
+#include <system_error>
+#include <type_traits>
+
+namespace rio {
+
+// Errors of rio's non-throwing API (the try_* functions), in rio_category().
+// Failed syscalls are reported in std::system_category() instead.
+enum class errc {
+    fd_out_of_range = 1,
+    fd_not_registered,
+    fd_already_registered,
+    fd_not_readable,
+    fd_not_writable,
+    fd_dispatched_to_callback
+};
+
+std::error_category const& rio_category() noexcept;
+
+inline std::error_code make_error_code(errc e) noexcept {
+    return { static_cast<int>(e), rio_category() };
+}
+
+template<typename T = void>
+using result = std::expected<T, std::error_code>;
+
+}
+
+template<>
+struct std::is_error_code_enum<rio::errc> : std::true_type { };
+
+#endif // _RIO_COMMON_ERRC_HPP
@@ -17,6 +17,7 @@ namespace rio {
 
 _NEW_LOGIC_ERROR(multiple_event_loops_exception, "multiple event loops exists at the same time");
 _NEW_LOGIC_ERROR(bad_event_loop_access, "bad event loop access");
+_NEW_LOGIC_ERROR(simulation_stalled_exception, "simulated event loop would wait forever");
 
 }
 
@@ -0,0 +1,23 @@
+#ifndef _RIO_COMMON_LOOP_PHASE_HPP
+#define _RIO_COMMON_LOOP_PHASE_HPP
+
+#include <cstdint>
+
+namespace rio {
+
+// Point of every loop iteration where a loop_hook runs.
+enum class loop_phase : std::uint8_t {
+    // Before anything else, and the loop won't block in the selector while
+    // an idle hook is active: for background work done a slice at a time.
+    idle,
+    // Right before the loop waits in the selector: for flushing work batched
+    // during the iteration.
+    prepare,
+    // Right after the iteration dispatched its events and ran everything
+    // that became ready.
+    check
+};
+
+}
+
+#endif // _RIO_COMMON_LOOP_PHASE_HPP
@@ -0,0 +1,18 @@
+#ifndef _RIO_COMMON_MISSED_TICKS_HPP
+#define _RIO_COMMON_MISSED_TICKS_HPP
+
+#include <cstdint>
+
+namespace rio {
+
+// What a periodic timer does with the ticks it missed while the loop was busy.
+enum class missed_ticks : std::uint8_t {
+    // Fires once, and resumes the cadence from the next deadline in the future.
+    skip,
+    // Fires once per missed tick, back to back, until it is on time again.
+    catch_up
+};
+
+}
+
+#endif // _RIO_COMMON_MISSED_TICKS_HPP
@@ -0,0 +1,23 @@
+#ifndef _RIO_COMMON_PRIORITY_HPP
+#define _RIO_COMMON_PRIORITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rio {
+
+// Dispatch class of scheduled work and I/O waiters. Within an iteration of
+// the loop, everything that became ready runs in class order, so control
+// traffic isn't stuck behind bulk work, and since every class runs before
+// the loop waits again no class starves.
+enum class priority : std::uint8_t {
+    high,
+    normal,
+    low
+};
+
+constexpr std::size_t num_priorities = 3;
+
+}
+
+#endif // _RIO_COMMON_PRIORITY_HPP
@@ -0,0 +1,21 @@
+#ifndef _RIO_COMMON_TRIGGER_MODE_HPP
+#define _RIO_COMMON_TRIGGER_MODE_HPP
+
+#include <cstdint>
+
+namespace rio {
+
+// How the selector reports readiness of a registered fd.
+enum class trigger_mode : std::uint8_t {
+    // Reported once per readiness change (EPOLLET).
+    edge,
+    // Reported on every wait while the fd is ready.
+    level,
+    // Reported once, then the fd is disarmed until its interest is modified
+    // again (EPOLLONESHOT).
+    oneshot
+};
+
+}
+
+#endif // _RIO_COMMON_TRIGGER_MODE_HPP
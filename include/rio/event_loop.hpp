@@ -1,13 +1,29 @@
 #ifndef _RIO_EVENT_LOOP_HPP
 #define _RIO_EVENT_LOOP_HPP
 
+#include <atomic>
 #include <coroutine>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "tsl/macros.hpp"
+#include "rio/common/errc.hpp"
 #include "rio/common/file_ops.hpp"
+#include "rio/common/loop_phase.hpp"
+#include "rio/common/missed_ticks.hpp"
+#include "rio/common/priority.hpp"
 #include "rio/common/time_type.hpp"
+#include "rio/common/trigger_mode.hpp"
 #include "rio/common/coro_traits.hpp"
 
 #include "rio/common/event_loop_exceptions.hpp" // IWYU pragma: export
+#include "rio/internal/intrusive_list.hpp"
+#include "rio/internal/mpsc_queue.hpp"
 #include "rio/selector.hpp"
 
 namespace rio {
@@ -21,8 +37,20 @@ concept Schedulable = std::convertible_to<T, void(*)()>
                    || AwaitSchedulable<T>;
 
 // TODO: Check multiple event loops only when running instead of when constructing
+class blocking_io_pool;
+class buffer_pool;
+class simulation;
+class stall_watchdog;
+
 class event_loop_t {
     struct file_internal;
+    struct signal_internal;
+
+    // Work submitted from other threads, see post().
+    struct remote_node : internal::mpsc_node {
+        // Runs the work, or only releases it if `run` is false.
+        void (*fn_)(remote_node* node, bool run);
+    };
 
     enum class schedule_type {
         FUNCTION,
@@ -33,8 +61,8 @@ class event_loop_t {
 
     class base_awaiter {
     public:
-        base_awaiter(event_loop_t& loop, int fd) noexcept
-            : loop_(loop), fd_(fd) { }
+        base_awaiter(event_loop_t& loop, int fd, priority prio = priority::normal) noexcept
+            : loop_(loop), fd_(fd), prio_(prio) { }
 
         bool await_ready() const noexcept {
             return false;
@@ -44,9 +72,12 @@ class event_loop_t {
     protected:
         event_loop_t& loop_;
         int fd_;
+        priority prio_;
     };
 public:
     using schedulable_func_t = void(*)();
+    using fd_callback_t = void(*)(void* ctx, selector::events ev);
+    using signal_handler_t = void(*)(int signo);
 
     // max_fileno is set to the process's hard limit for the file number
     event_loop_t();
@@ -54,6 +85,10 @@ public:
     // max_fileno: hard limit for the file descriptor number
     event_loop_t(std::size_t max_fileno);
 
+    // A loop running on simulated time: its clock and selector are `sim`'s,
+    // see rio::simulation. `sim` must outlive the loop.
+    explicit event_loop_t(simulation& sim, std::size_t max_fileno = 1024);
+
     ~event_loop_t();
 
     event_loop_t(event_loop_t const&) = delete;
@@ -74,72 +109,446 @@ public:
         return loop_ != nullptr;
     }
     
+    // Runs until nothing is scheduled, no fd is registered and no reference
+    // is held, or until stop() is called.
     void run();
-    void schedule(Schedulable auto&& s, time_type delay = {});
-    void schedule_i(schedulable_func_t s, time_type delay = {});
-    void schedule_a(AwaitSchedulable auto&& s, time_type delay = {});
 
-    void add_fd(int fd, file_ops ops);
+    // Runs a single iteration: waits for events for up to `timeout` (or until
+    // the next timer, if sooner), then runs everything that became ready.
+    // Without a timeout it waits as long as needed, but returns at once if
+    // nothing could wake the loop up. Returns whether the loop is alive().
+    // Like run(), it must not be called from inside the loop.
+    bool run_once(std::optional<time_type> timeout = std::nullopt);
+
+    // Runs iterations for up to `duration`. Returns whether the loop is alive().
+    bool run_for(time_type duration);
+
+    // Makes run() and run_for() return after the current iteration.
+    void stop() noexcept;
+
+    // Whether anything is scheduled, an fd is registered or a reference held.
+    bool alive() const noexcept;
+
+    // To embed the loop into another one: the host polls backend_fd() for
+    // readability, with a timeout up to next_deadline(), and calls
+    // run_once(time_type {}) whenever either fires. -1 for a simulated loop.
+    int backend_fd() const noexcept {
+        return selector_.native_handle();
+    }
+
+    // When the loop must run next to fire its earliest timer, if it has any.
+    std::optional<time_type> next_deadline() const noexcept;
+
+    // Current time of the loop's clock: the monotonic clock, or the virtual
+    // clock of a simulated loop.
+    time_type now() const noexcept;
+
+    // Time of the loop's clock read once per iteration, when the loop wakes
+    // up. Cheaper than now() when being off by the iteration's work is fine.
+    time_type loop_time() const noexcept {
+        return loop_time_;
+    }
+
+    bool is_simulated() const noexcept {
+        return sim_ != nullptr;
+    }
+    void schedule(Schedulable auto&& s, time_type delay = {}, priority prio = priority::normal);
+    void schedule_i(schedulable_func_t s, time_type delay = {}, priority prio = priority::normal);
+    void schedule_a(AwaitSchedulable auto&& s, time_type delay = {}, priority prio = priority::normal);
+
+    // `ops` is the set of directions that may be awaited. The fd is only
+    // interested in a direction while a coroutine waits on it: a direction
+    // that reports readiness with nobody waiting is dropped from the interest
+    // set, and re-armed once a coroutine waits on it again. Edge-triggered fds
+    // start interested in every direction in `ops`, the others in none.
+    //
+    // The fd only enters the selector when a coroutine first suspends on it,
+    // so an fd served by optimistic I/O alone costs no epoll_ctl at all.
+    // Later interest changes are batched and applied before the loop waits.
+    void add_fd(int fd, file_ops ops, trigger_mode mode = trigger_mode::edge);
     void del_fd(int fd);
 
+    // Non-throwing add_fd/del_fd for paths where failures are expected, like
+    // connection churn: errors are returned as rio::errc or errno codes, with
+    // no exception and no message formatting.
+    result<> try_add_fd(int fd, file_ops ops, trigger_mode mode = trigger_mode::edge);
+    result<> try_del_fd(int fd);
+
+    // Overrides the directions the selector currently reports for `fd`,
+    // re-arming it if it is oneshot.
+    void set_interest(int fd, file_ops ops);
+
+    // Registers an fd whose readiness is dispatched to `callback` instead of
+    // waking awaiters. Used by rio's own components (signalfd, eventfds, ...),
+    // these fds don't keep run() alive, use ref()/unref() for that.
+    void add_fd(int fd, file_ops ops, fd_callback_t callback, void* ctx);
+
+    // run() keeps running while there are references, even if nothing is
+    // scheduled and no fd is registered.
+    void ref() noexcept {
+        refs_++;
+    }
+
+    void unref() noexcept {
+        TSL_ASSERT(refs_ > 0);
+        refs_--;
+    }
+
+    class signal_awaiter {
+    public:
+        signal_awaiter(event_loop_t& loop, int signo, priority prio) noexcept
+            : loop_(loop), signo_(signo), prio_(prio) { }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> coro);
+
+        int await_resume() const noexcept {
+            return signo_;
+        }
+    private:
+        event_loop_t& loop_;
+        int signo_;
+        priority prio_;
+    };
+
+    // Waits for the next delivery of `signo`. Watched signals are blocked
+    // for the loop thread and read from a signalfd, so they should also be
+    // blocked on every other thread for reliable delivery.
+    signal_awaiter signal(int signo, priority prio = priority::normal) {
+        return signal_awaiter { *this, signo, prio };
+    }
+
+    // Calls `handler` on the loop thread every time `signo` is delivered.
+    // A registered handler keeps run() alive until it is removed.
+    void on_signal(int signo, signal_handler_t handler);
+    void remove_signal_handler(int signo);
+
+    // Readiness of every registered fd is cached from its edges, so callers
+    // can skip syscalls bound to fail: a direction stays ready until a
+    // coroutine waits on it, which it only does after seeing EAGAIN, or until
+    // clear_ready. await_read and await_write always wait for the next
+    // readiness report, await_readable and await_writable don't wait for a
+    // direction already ready.
+    file_ops readiness(int fd) const noexcept;
+    void clear_ready(int fd, file_ops ops);
+
     class read_awaiter final : public base_awaiter {
     public:
         using base_awaiter::base_awaiter;
+
         void await_suspend(std::coroutine_handle<> coro);
     };
-    read_awaiter await_read(int fd) {
-        return read_awaiter { *this, fd };
+    read_awaiter await_read(int fd, priority prio = priority::normal) {
+        return read_awaiter { *this, fd, prio };
     }
 
     class write_awaiter final : public base_awaiter {
     public:
         using base_awaiter::base_awaiter;
+
         void await_suspend(std::coroutine_handle<> coro);
     };
-    write_awaiter await_write(int fd) {
-        return write_awaiter { *this, fd };
+    write_awaiter await_write(int fd, priority prio = priority::normal) {
+        return write_awaiter { *this, fd, prio };
     }
 
-    auto sleep_for(time_type delay) {
+    // Like read_awaiter and write_awaiter, but completes without suspending
+    // when the direction is cached ready, saving a loop iteration. Meant for
+    // code that waits before its syscall: after seeing EAGAIN, wait with
+    // await_read or await_write instead, which always wait for a new edge.
+    class ready_awaiter final : public base_awaiter {
+    public:
+        ready_awaiter(event_loop_t& loop, int fd, file_ops op, priority prio) noexcept
+            : base_awaiter(loop, fd, prio), op_(op) { }
+
+        bool await_ready() const noexcept {
+            return bool(loop_.readiness(fd_) & op_);
+        }
+
+        void await_suspend(std::coroutine_handle<> coro);
+    private:
+        file_ops op_;
+    };
+    ready_awaiter await_readable(int fd, priority prio = priority::normal) {
+        return ready_awaiter { *this, fd, file_ops::readable, prio };
+    }
+    ready_awaiter await_writable(int fd, priority prio = priority::normal) {
+        return ready_awaiter { *this, fd, file_ops::writable, prio };
+    }
+
+    // Like read_awaiter and write_awaiter, but a failure to wait (the fd isn't
+    // registered, or epoll rejects it) resumes with the error at once instead
+    // of throwing into the awaiting coroutine.
+    class try_awaiter final : public base_awaiter {
+    public:
+        try_awaiter(event_loop_t& loop, int fd, file_ops op, priority prio) noexcept
+            : base_awaiter(loop, fd, prio), op_(op) { }
+
+        bool await_suspend(std::coroutine_handle<> coro);
+
+        result<> await_resume() const noexcept {
+            if (ec_) [[unlikely]]
+                return std::unexpected(ec_);
+            return {};
+        }
+    private:
+        file_ops op_;
+        std::error_code ec_;
+    };
+    try_awaiter try_await_read(int fd, priority prio = priority::normal) {
+        return try_awaiter { *this, fd, file_ops::readable, prio };
+    }
+    try_awaiter try_await_write(int fd, priority prio = priority::normal) {
+        return try_awaiter { *this, fd, file_ops::writable, prio };
+    }
+
+    // MSG_ZEROCOPY sends in flight on a socket, see rio/zerocopy.hpp. The
+    // kernel numbers the successful zerocopy sends of each socket, and
+    // zerocopy_sent() records one and returns its id. Completions are reaped
+    // from the socket's error queue when the selector reports an error on it.
+    std::uint32_t zerocopy_sent(int fd);
+
+    // Whether the kernel reported copying the data of a zerocopy send anyway,
+    // in which case zerocopy is only overhead on this socket.
+    bool zerocopy_copied(int fd) const;
+
+    class zerocopy_awaiter final : public base_awaiter {
+    public:
+        zerocopy_awaiter(event_loop_t& loop, int fd, std::uint32_t id, priority prio) noexcept
+            : base_awaiter(loop, fd, prio), id_(id) { }
+
+        bool await_ready() const noexcept {
+            return loop_.zerocopy_done(fd_, id_);
+        }
+
+        void await_suspend(std::coroutine_handle<> coro);
+    private:
+        std::uint32_t id_;
+    };
+
+    // Waits until the kernel released the pages of zerocopy send `id`.
+    zerocopy_awaiter await_zerocopy(int fd, std::uint32_t id, priority prio = priority::normal) {
+        return zerocopy_awaiter { *this, fd, id, prio };
+    }
+
+    // Timers may fire up to `slack` after their deadline, so timers whose
+    // windows overlap are coalesced into a single wakeup. The loop's default
+    // slack is used by schedule and sleep_for when none is given, except for
+    // zero delays which always run as soon as possible.
+    void set_timer_slack(time_type slack) noexcept {
+        timer_slack_ = slack;
+    }
+
+    time_type timer_slack() const noexcept {
+        return timer_slack_;
+    }
+
+    struct busy_poll_stats {
+        // Total time spent in non-blocking waits.
+        time_type spin_time;
+        // Number of non-blocking waits, and how many of them returned events.
+        std::uint64_t spins = 0;
+        std::uint64_t hits = 0;
+    };
+
+    // Hybrid busy-poll mode: for `spin` after the last iteration that did any
+    // work, the loop polls the selector without blocking instead of sleeping
+    // in it, trading CPU for wakeup latency. Zero (the default) disables it.
+    // See also selector::set_busy_poll for kernel-side busy polling.
+    void set_busy_poll(time_type spin) noexcept {
+        busy_poll_ = spin;
+    }
+
+    time_type busy_poll() const noexcept {
+        return busy_poll_;
+    }
+
+    busy_poll_stats const& get_busy_poll_stats() const noexcept {
+        return busy_poll_stats_;
+    }
+
+    // Runs `f` on the loop thread. Unlike everything else in the loop, post()
+    // and resume_on() may be called from any thread. Bursts of posts are
+    // coalesced into a single eventfd wakeup.
+    //
+    // Posted work doesn't keep run() alive, so the loop should hold a ref()
+    // while other threads may still post to it.
+    template<std::invocable F>
+    void post(F&& f);
+
+    class resume_on_awaiter : private remote_node {
+    public:
+        explicit resume_on_awaiter(event_loop_t& loop) noexcept
+            : loop_(loop) { }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> coro) noexcept {
+            coro_ = coro;
+            // Dropped at loop teardown, the coroutine is left suspended: its
+            // frame may belong to a task awaited elsewhere, which destroys it.
+            fn_ = [](remote_node* node, bool run) {
+                if (run)
+                    static_cast<resume_on_awaiter*>(node)->coro_.resume();
+            };
+            loop_.post_node(this);
+        }
+
+        void await_resume() const noexcept { }
+    private:
+        event_loop_t& loop_;
+        std::coroutine_handle<> coro_;
+    };
+
+    // Moves the awaiting coroutine to the loop thread. If the loop is
+    // destroyed first, the coroutine is never resumed nor destroyed, and a
+    // frame nobody owns leaks: hold a ref() until every resume_on() is done.
+    resume_on_awaiter resume_on() noexcept {
+        return resume_on_awaiter { *this };
+    }
+
+    // Pool running blocking file I/O for this loop, created on first use.
+    blocking_io_pool& io_pool();
+
+    // Receive buffers shared by the loop's connections, see
+    // async_read_pooled. Created on first use.
+    buffer_pool& buffers();
+
+    selector& get_selector() noexcept {
+        return selector_;
+    }
+
+    class periodic_timer;
+
+    // Callback run at a loop_phase of every iteration, see rio::loop_hook.
+    class hook;
+
+    // Calls `f` every `interval`, on a periodic_timer, until it returns false
+    // (if it returns bool at all). A running periodic call keeps run() alive.
+    template<std::invocable F>
+    void every(time_type interval, F&& f, missed_ticks policy = missed_ticks::skip);
+
+    auto sleep_for(time_type delay, time_type slack, priority prio) {
         class awaitable {
         public:
-            explicit awaitable(event_loop_t& loop, time_type delay) : loop_(loop), delay_(delay) { }
+            explicit awaitable(event_loop_t& loop, time_type delay, time_type slack, priority prio)
+                : loop_(loop), delay_(delay), slack_(slack), prio_(prio) { }
 
             bool await_ready() const noexcept {
                 return false;
             }
 
             void await_suspend(std::coroutine_handle<> coro) const {
-                auto time = time_type::monotonic_clock() + delay_;
-                loop_.scheduled_.emplace(coro, time);
+                auto time = loop_.now() + delay_;
+                loop_.scheduled_.emplace(coro, time, slack_, prio_);
             }
 
             void await_resume() const noexcept { }
         private:
             event_loop_t& loop_;
             time_type delay_;
+            time_type slack_;
+            priority prio_;
         };
 
-        return awaitable { *this, delay };
+        return awaitable { *this, delay, slack, prio };
+    }
+
+    auto sleep_for(time_type delay, time_type slack) {
+        return sleep_for(delay, slack, priority::normal);
+    }
+
+    auto sleep_for(time_type delay, priority prio) {
+        return sleep_for(delay, default_slack(delay), prio);
+    }
+
+    auto sleep_for(time_type delay) {
+        return sleep_for(delay, default_slack(delay), priority::normal);
     }
 
 private:
+    friend class stall_watchdog;
+
     static event_loop_t *loop_;
 
+    event_loop_t(std::size_t max_fileno, simulation* sim);
+
     [[noreturn]] static void throw_bad_event_loop_access();
+    [[noreturn]] static void throw_fd_error(std::error_code ec, int fd,
+                                            const char* what = "selector: add_fd: epoll_ctl");
+    std::error_code check_fd(int fd) const noexcept;
     void ensure_fd_in_range(int fd) const;
+
+    time_type default_slack(time_type delay) const noexcept {
+        return delay.as_ns() > 0 ? timer_slack_ : time_type {};
+    }
+
     void ensure_fd_registered(int fd) const;
 
     // TODO: These functions should allow normal functions too, so maybe
     // we should receive a scheduled_handle instead of a coroutine handle.
-    void push_read_clb(int fd, std::coroutine_handle<> coro);
-    void push_write_clb(int fd, std::coroutine_handle<> coro);
+    std::error_code push_clb(int fd, file_ops op, std::coroutine_handle<> coro, priority prio,
+                             std::error_code* ec = nullptr);
+    void push_read_clb(int fd, std::coroutine_handle<> coro, priority prio);
+    void push_write_clb(int fd, std::coroutine_handle<> coro, priority prio);
+
+    void wait_events(std::vector<selector::event_data>& events, std::optional<time_type> timeout);
+    void select(std::vector<selector::event_data>& events, std::optional<time_type> timeout);
+
+    std::error_code register_fd(file_internal& file);
+    static bool is_current(file_internal const& file, selector::event_data const& ev) noexcept;
+    void modify_interest(file_internal& file, file_ops interest);
+    void update_interest(file_internal& file, selector::events fired);
+    void flush_interest();
+    void fail_waiters(file_internal& file, std::error_code ec);
+
+    bool zerocopy_done(int fd, std::uint32_t id) const noexcept;
+    selector::events reap_zerocopy(file_internal& file, time_type current_time);
+
+    void run_hooks(loop_phase phase);
+
+    void post_node(remote_node* node) noexcept;
+    static void on_remote_wakeup(void* ctx, selector::events ev);
+
+    signal_internal& watch_signal(int signo);
+    static void on_signalfd(void* ctx, selector::events ev);
 
     schedulable_task make_schedulable_task(AwaitSchedulable auto s);
 
+    template<typename F>
+    schedulable_task make_periodic_task(time_type interval, F f, missed_ticks policy);
+
     file_internal* files_;
     std::size_t* constructed_files_;
     selector selector_;
+    simulation* sim_ = nullptr;
+
+    // Number of fds registered with add_fd that can be awaited.
+    std::size_t num_fds_ = 0;
+    std::size_t refs_ = 0;
+
+    // Registered fds whose interest changed since the last flush_interest().
+    std::vector<int> dirty_;
+
+    internal::mpsc_queue<remote_node> remote_queue_;
+    std::atomic<bool> remote_wakeup_pending_ { false };
+    int remote_efd_ = -1;
+
+    // Active hooks, by loop_phase.
+    internal::intrusive_list<hook> hooks_[3];
+
+    // Set while a stall_watchdog watches the loop.
+    stall_watchdog* watchdog_ = nullptr;
+    class watchdog_scope;
+
+    std::unique_ptr<signal_internal> signals_;
+    std::unique_ptr<blocking_io_pool> io_pool_;
+    std::unique_ptr<buffer_pool> buffers_;
 
     // ngl, im really considering using another mmap allocation for this,
     // just because it's fun
@@ -147,12 +556,25 @@ private:
                         std::vector<scheduled_handle>,
                         std::greater<scheduled_handle>> scheduled_;
 
+    // Handles that became ready in the current iteration, by priority.
+    std::vector<scheduled_handle> ready_[num_priorities];
+
+    time_type timer_slack_;
+    time_type loop_time_;
+
+    std::vector<selector::event_data> events_;
+    bool stopped_ = false;
+
+    time_type busy_poll_;
+    time_type last_activity_;
+    busy_poll_stats busy_poll_stats_;
+
     const std::size_t max_fileno_;
 };
 
 struct event_loop_t::file_internal {
     file_internal(int fd) noexcept
-        : fd_(fd), constructed_(true), valid_(false) { }
+        : fd_(fd), constructed_(true), valid_(false), generation_(0) { }
 
     // If file_internal was zero-initialized, it's invalid, so it
     // must be constructed before being used.
@@ -166,22 +588,81 @@ struct event_loop_t::file_internal {
 
     const int fd_;
     file_ops ops_;
+    // Directions known to be ready since the last edge, see readiness().
+    file_ops ready_;
+    // Directions the selector currently reports, see add_fd().
+    file_ops interest_;
+    trigger_mode mode_;
     bool constructed_;
     bool valid_;
+    // Bumped by del_fd, and passed to the selector as the registration's tag,
+    // so events of a previous registration of the same fd can be told apart.
+    std::uint32_t generation_;
+    // In the selector, see add_fd().
+    bool registered_;
+    // Queued in dirty_, its interest must be flushed to the selector.
+    bool dirty_;
+
+    // Set for fds registered with a callback, see add_fd.
+    fd_callback_t callback_;
+    void* callback_ctx_;
 
     // TODO: Queue is not the right data structure here, we need to be able to
     //      remove elements from the middle of the queue to allow cancelling
     //      coroutines that are waiting for I/O, like when timeouts are reached.
-    std::queue<std::coroutine_handle<>> reading_;
-    std::queue<std::coroutine_handle<>> writing_;
+    struct waiter {
+        std::coroutine_handle<> coro;
+        priority prio;
+        // Where to report a failure to wait, for a try_awaiter.
+        std::error_code* ec;
+    };
+
+    std::queue<waiter> reading_;
+    std::queue<waiter> writing_;
+
+    // MSG_ZEROCOPY sends, see zerocopy_sent(). Every id before zc_done_ has
+    // completed, the kernel reports completions in order.
+    std::uint32_t zc_next_;
+    std::uint32_t zc_done_;
+    bool zc_copied_;
+
+    struct zc_waiter {
+        std::coroutine_handle<> coro;
+        priority prio;
+        std::uint32_t id;
+    };
+
+    std::vector<zc_waiter> zc_waiting_;
+};
+
+struct event_loop_t::signal_internal {
+    signal_internal() noexcept = default;
+    ~signal_internal();
+
+    signal_internal(signal_internal const&) = delete;
+    signal_internal& operator=(signal_internal const&) = delete;
+
+    int fd_ = -1;
+    sigset_t mask_;
+    sigset_t old_mask_;
+
+    struct waiter {
+        std::coroutine_handle<> coro;
+        priority prio;
+    };
+
+    std::vector<waiter> waiters_[NSIG];
+    signal_handler_t handlers_[NSIG] = {};
 };
 
 class event_loop_t::scheduled_handle {
 public:
-    scheduled_handle(std::coroutine_handle<> coro, time_type delay) noexcept
-        : type_(schedule_type::COROUTINE), coro_(coro), time_(delay) { }
-    scheduled_handle(schedulable_func_t func, time_type time) noexcept
-        : type_(schedule_type::FUNCTION), func_(func), time_(time) { }
+    scheduled_handle(std::coroutine_handle<> coro, time_type time, time_type slack = {},
+                     priority prio = priority::normal) noexcept
+        : type_(schedule_type::COROUTINE), prio_(prio), coro_(coro), time_(time), deadline_(time + slack) { }
+    scheduled_handle(schedulable_func_t func, time_type time, time_type slack = {},
+                     priority prio = priority::normal) noexcept
+        : type_(schedule_type::FUNCTION), prio_(prio), func_(func), time_(time), deadline_(time + slack) { }
 
     void run() {
         switch (type_) {
@@ -198,22 +679,44 @@ public:
         return type_;
     }
 
+    priority prio() const noexcept {
+        return prio_;
+    }
+
+    // Code the handle runs: the function, or the coroutine's resume function,
+    // which GCC and Clang store as the first word of the coroutine frame.
+    void* source() const noexcept {
+        if (type_ == schedule_type::FUNCTION)
+            return reinterpret_cast<void*>(func_);
+        return *static_cast<void**>(coro_.address());
+    }
+
+    // Earliest time the handle may run.
     time_type time() const noexcept {
         return time_;
     }
 
-    // TODO: priorities
+    // Latest time the handle should run, i.e. time() plus its slack.
+    time_type deadline() const noexcept {
+        return deadline_;
+    }
+
+    // Ordered by deadline, so the top of the queue is the next time the loop
+    // must wake up. Every handle whose time() already passed is run with it.
+    // Priorities don't take part: due handles are dispatched by class in run().
     std::weak_ordering operator<=>(scheduled_handle const& other) const noexcept {
-        return time_ <=> other.time_;
+        return deadline_ <=> other.deadline_;
     }
 
 private:
     schedule_type type_;
+    priority prio_;
     union {
         std::coroutine_handle<> coro_;
         schedulable_func_t func_;
     };
     time_type time_;
+    time_type deadline_;
 };
 
 class event_loop_t::schedulable_task {
@@ -243,9 +746,9 @@ public:
         std::exception_ptr exception_;
     };
 
-    void schedule(event_loop_t& loop, time_type delay) {
-        auto time = time_type::monotonic_clock() + delay;
-        loop.scheduled_.emplace(coro_, time);
+    void schedule(event_loop_t& loop, time_type delay, priority prio) {
+        auto time = loop.now() + delay;
+        loop.scheduled_.emplace(coro_, time, loop.default_slack(delay), prio);
     }
 
     explicit schedulable_task(std::coroutine_handle<promise_type> coro) noexcept
@@ -256,6 +759,148 @@ private:
 };
 
 
+// Fires at absolute deadlines `interval` apart, counted from its creation,
+// so the time spent by whoever awaits it doesn't accumulate as drift. Each
+// co_await rearms the same timer, without reading the clock. Awaiting it
+// resumes with the number of ticks since the previous one: 1 when on time,
+// more when missed ticks were skipped.
+class event_loop_t::periodic_timer {
+public:
+    explicit periodic_timer(time_type interval, missed_ticks policy = missed_ticks::skip,
+                            event_loop_t& loop = event_loop_t::get())
+        : loop_(loop), interval_(interval), next_(loop.now() + interval), policy_(policy)
+    {
+        if (interval_.as_ns() <= 0)
+            throw std::invalid_argument("periodic_timer: interval must be > 0");
+    }
+
+    time_type interval() const noexcept {
+        return interval_;
+    }
+
+    // Deadline of the next tick.
+    time_type next() const noexcept {
+        return next_;
+    }
+
+    // Restarts the cadence from now.
+    void reset() noexcept {
+        next_ = loop_.now() + interval_;
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> coro) {
+        loop_.scheduled_.emplace(coro, next_, loop_.default_slack(interval_), priority::normal);
+    }
+
+    std::uint64_t await_resume() noexcept {
+        next_ += interval_;
+        if (policy_ == missed_ticks::catch_up)
+            return 1;
+
+        auto late = loop_.loop_time() - next_;
+        if (late.as_ns() < 0)
+            return 1;
+
+        std::uint64_t missed = late.as_ns() / interval_.as_ns() + 1;
+        next_ += time_type::from_ns(missed * interval_.as_ns());
+        return missed + 1;
+    }
+
+private:
+    event_loop_t& loop_;
+    time_type interval_;
+    time_type next_;
+    missed_ticks policy_;
+};
+
+// Runs `callback(ctx)` at `phase` of every iteration of the loop while it is
+// active. The hook is owned by the caller and linked into the loop in place,
+// so starting and stopping it never allocates. Active hooks don't keep run()
+// alive, use ref()/unref() for that.
+//
+// A callback may start or stop any hook, itself included. Hooks started
+// while their phase runs first run in the next iteration.
+class event_loop_t::hook : private internal::list_node {
+public:
+    using callback_t = void(*)(void* ctx);
+
+    hook(loop_phase phase, callback_t callback, void* ctx, event_loop_t& loop = event_loop_t::get()) noexcept
+        : loop_(loop), callback_(callback), ctx_(ctx), phase_(phase) { }
+
+    ~hook() {
+        stop();
+    }
+
+    hook(hook const&) = delete;
+    hook& operator=(hook const&) = delete;
+
+    void start() noexcept {
+        if (!is_linked())
+            loop_.hooks_[static_cast<std::size_t>(phase_)].push_back(this);
+    }
+
+    void stop() noexcept {
+        unlink();
+    }
+
+    bool active() const noexcept {
+        return is_linked();
+    }
+
+    loop_phase phase() const noexcept {
+        return phase_;
+    }
+
+private:
+    friend class event_loop_t;
+    friend class internal::intrusive_list<hook>;
+
+    event_loop_t& loop_;
+    callback_t callback_;
+    void* ctx_;
+    loop_phase phase_;
+};
+
+template<typename F>
+event_loop_t::schedulable_task event_loop_t::make_periodic_task(time_type interval, F f, missed_ticks policy) {
+    periodic_timer timer { interval, policy, *this };
+    for (;;) {
+        co_await timer;
+        if constexpr (std::same_as<std::invoke_result_t<F&>, bool>) {
+            if (!f())
+                co_return;
+        } else {
+            f();
+        }
+    }
+}
+
+template<std::invocable F>
+void event_loop_t::every(time_type interval, F&& f, missed_ticks policy) {
+    auto task = make_periodic_task<std::decay_t<F>>(interval, std::forward<F>(f), policy);
+    task.schedule(*this, {}, priority::normal);
+}
+
+template<std::invocable F>
+void event_loop_t::post(F&& f) {
+    struct node : remote_node {
+        explicit node(F&& f) : f_(std::forward<F>(f)) { }
+        std::decay_t<F> f_;
+    };
+
+    auto n = new node(std::forward<F>(f));
+    n->fn_ = [](remote_node* rn, bool run) {
+        std::unique_ptr<node> self { static_cast<node*>(rn) };
+        if (run)
+            self->f_();
+    };
+    post_node(n);
+}
+
 template <AwaitSchedulable Schedulable>
 event_loop_t::schedulable_task event_loop_t::make_schedulable_task(Schedulable s) {
     if constexpr (Awaitable<Schedulable>) {
@@ -266,7 +911,7 @@ event_loop_t::schedulable_task event_loop_t::make_schedulable_task(Schedulable s
 }
 
 template <Schedulable Schedulable>
-void event_loop_t::schedule(Schedulable&& s, time_type delay) {
+void event_loop_t::schedule(Schedulable&& s, time_type delay, priority prio) {
     if constexpr (AwaitSchedulable<Schedulable>) {
         static_assert(!std::convertible_to<Schedulable, void(*)()>,
                 "Schedulable type cannot be both invocable and AwaitSchedulable, "
@@ -275,22 +920,25 @@ void event_loop_t::schedule(Schedulable&& s, time_type delay) {
                 "Schedulable type cannot be both Awaitable and AwaitCallable, use "
                 "schedule_a instead.");
 
-        return schedule_a(std::forward<Schedulable>(s), delay);
+        return schedule_a(std::forward<Schedulable>(s), delay, prio);
     } else {
-        return schedule_i(std::forward<Schedulable>(s), delay);
+        return schedule_i(std::forward<Schedulable>(s), delay, prio);
     }
 }
 
-inline void event_loop_t::schedule_i(schedulable_func_t s, time_type delay) {
-    auto time = time_type::monotonic_clock() + delay;
-    scheduled_.emplace(s, time);
+inline void event_loop_t::schedule_i(schedulable_func_t s, time_type delay, priority prio) {
+    auto time = now() + delay;
+    scheduled_.emplace(s, time, default_slack(delay), prio);
 }
 
-void event_loop_t::schedule_a(AwaitSchedulable auto&& s, time_type delay) {
+void event_loop_t::schedule_a(AwaitSchedulable auto&& s, time_type delay, priority prio) {
     auto task = make_schedulable_task(std::forward<decltype(s)>(s));
-    task.schedule(*this, delay);
+    task.schedule(*this, delay, prio);
 }
 
+using periodic_timer = event_loop_t::periodic_timer;
+using loop_hook = event_loop_t::hook;
+
 // global functions
 
 inline event_loop_t& get_event_loop() {
@@ -310,6 +958,7 @@ _FORWARD_TO_LOOP(schedule);
 _FORWARD_TO_LOOP(schedule_i);
 _FORWARD_TO_LOOP(schedule_a);
 _FORWARD_TO_LOOP(sleep_for);
+_FORWARD_TO_LOOP(every);
 
 #undef _FORWARD_TO_LOOP
 
@@ -0,0 +1,104 @@
+#ifndef _RIO_FILE_WATCHER_HPP
+#define _RIO_FILE_WATCHER_HPP
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <sys/inotify.h>
+#include <unordered_map>
+#include "rio/selector.hpp"
+#include "rio/task.hpp"
+
+namespace rio {
+
+class event_loop_t;
+
+struct watch_event {
+    // Watch descriptor the event is for, see file_watcher::add_watch.
+    int wd;
+    // IN_* bits, IN_Q_OVERFLOW if events were lost, IN_IGNORED once the
+    // watch is gone.
+    std::uint32_t mask;
+    // Pairs the IN_MOVED_FROM and IN_MOVED_TO events of a rename.
+    std::uint32_t cookie;
+    // Name of the entry inside a watched directory, empty otherwise.
+    std::string name;
+};
+
+// An inotify instance registered in the loop. Events are read in batches
+// when the selector reports the fd and handed to the coroutines waiting on
+// their watch descriptor, so watching costs nothing while nothing changes.
+// Events nobody waits for yet are queued per watch.
+class file_watcher {
+    struct watch {
+        std::deque<watch_event> events;
+        std::deque<std::coroutine_handle<>> waiters;
+        // The kernel sent IN_IGNORED, no more events will come.
+        bool removed = false;
+    };
+
+public:
+    explicit file_watcher(event_loop_t& loop);
+    file_watcher();
+    ~file_watcher();
+
+    file_watcher(file_watcher const&) = delete;
+    file_watcher& operator=(file_watcher const&) = delete;
+
+    // Starts watching `path` for the IN_* events in `mask`, returning its
+    // watch descriptor. Watching the same inode again returns the same
+    // descriptor, with its mask replaced.
+    int add_watch(const char* path, std::uint32_t mask);
+
+    // Stops watching and forgets `wd`, coroutines still waiting on it are
+    // never resumed.
+    void remove_watch(int wd);
+
+    class awaiter {
+    public:
+        awaiter(file_watcher& watcher, int wd) noexcept
+            : watcher_(watcher), wd_(wd) { }
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> coro);
+        watch_event await_resume();
+    private:
+        file_watcher& watcher_;
+        int wd_;
+    };
+
+    // Waits for the next event on `wd`. Awaiting a watch that was removed
+    // (after its IN_IGNORED event) throws std::invalid_argument.
+    awaiter next(int wd) noexcept {
+        return awaiter { *this, wd };
+    }
+
+    int fd() const noexcept {
+        return fd_;
+    }
+
+private:
+    class alive_guard;
+
+    static void on_readable(void* ctx, selector::events ev);
+    void dispatch(watch_event&& ev);
+    watch& get_watch(int wd);
+
+    event_loop_t& loop_;
+    int fd_;
+    std::unordered_map<int, watch> watches_;
+
+    // Set while dispatching, resumed coroutines may destroy the watcher.
+    // See alive_guard.
+    bool* alive_ = nullptr;
+};
+
+// Waits for the next of the IN_* events in `mask` on `path`. Every call uses
+// its own inotify instance, use a file_watcher to watch many paths or to not
+// miss events between waits.
+task<watch_event> watch(std::string path, std::uint32_t mask);
+
+}
+
+#endif // _RIO_FILE_WATCHER_HPP
@@ -0,0 +1,137 @@
+#ifndef _RIO_FRAMING_HPP
+#define _RIO_FRAMING_HPP
+
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+#include "rio/async_generator.hpp"
+#include "rio/event_loop.hpp"
+
+namespace rio {
+
+// A frame found by a decoder: `data` points into the decoded buffer, and
+// `consumed` bytes of the buffer (data plus delimiters or headers) belong to it.
+struct frame {
+    std::span<const std::byte> data;
+    std::size_t consumed;
+};
+
+// Decoders split a byte stream into frames. decode() is called with the
+// bytes not consumed yet, and returns the first frame in them, or nothing if
+// it is still incomplete. They remember how far they already scanned, so a
+// frame arriving in many reads is only scanned once. A frame longer than
+// `max_size` throws std::length_error.
+
+// Frames ended by `delimiter`, which is not part of the frame.
+class delimiter_decoder {
+public:
+    explicit delimiter_decoder(std::byte delimiter, std::size_t max_size = 64 * 1024) noexcept
+        : delimiter_(delimiter), max_size_(max_size) { }
+
+    std::optional<frame> decode(std::span<const std::byte> buf);
+
+private:
+    std::byte delimiter_;
+    std::size_t max_size_;
+    std::size_t scanned_ = 0;
+};
+
+// Lines ended by "\n" or "\r\n", without the line ending.
+class line_decoder {
+public:
+    explicit line_decoder(std::size_t max_size = 64 * 1024) noexcept
+        : delimiter_(std::byte { '\n' }, max_size) { }
+
+    std::optional<frame> decode(std::span<const std::byte> buf);
+
+private:
+    delimiter_decoder delimiter_;
+};
+
+// Frames preceded by their length as a big-endian integer of `header_size`
+// bytes (1, 2, 4 or 8). The header is not part of the frame.
+class length_prefixed_decoder {
+public:
+    explicit length_prefixed_decoder(std::size_t header_size = 4, std::size_t max_size = 1024 * 1024);
+
+    std::optional<frame> decode(std::span<const std::byte> buf);
+
+private:
+    std::size_t header_size_;
+    std::size_t max_size_;
+};
+
+// HTTP/1 header blocks, ended by an empty line ("\r\n\r\n", or a bare "\n\n"
+// as RFC 9112 allows). The frame includes the empty line.
+class http_header_decoder {
+public:
+    explicit http_header_decoder(std::size_t max_size = 64 * 1024) noexcept
+        : max_size_(max_size) { }
+
+    std::optional<frame> decode(std::span<const std::byte> buf);
+
+private:
+    std::size_t max_size_;
+    std::size_t scanned_ = 0;
+};
+
+template<typename T>
+concept Decoder = requires(T decoder, std::span<const std::byte> buf) {
+    { decoder.decode(buf) } -> std::same_as<std::optional<frame>>;
+};
+
+// Reads `fd` and yields the frames `decoder` finds in it, until the end of
+// file. Frames are spans over the read buffer, valid until the generator is
+// resumed. The buffer starts at `buffer_size` bytes and grows to fit larger
+// frames, up to the decoder's limit. A trailing incomplete frame at the end
+// of file is dropped. The fd must be non-blocking and registered in the
+// event loop as readable.
+template<Decoder D>
+async_generator<std::span<const std::byte>> read_frames(int fd, D decoder, std::size_t buffer_size = 16 * 1024) {
+    auto& loop = get_event_loop();
+    std::vector<std::byte> buf(buffer_size);
+    std::size_t begin = 0;
+    std::size_t end = 0;
+
+    for (;;) {
+        while (auto f = decoder.decode({ buf.data() + begin, end - begin })) {
+            begin += f->consumed;
+            co_yield f->data;
+        }
+
+        // Make room: move the incomplete frame to the front, or grow the
+        // buffer if it already fills it.
+        if (begin > 0) {
+            std::memmove(buf.data(), buf.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        } else if (end == buf.size()) {
+            buf.resize(buf.size() * 2);
+        }
+
+        ssize_t n = ::read(fd, buf.data() + end, buf.size() - end);
+        if (n > 0) {
+            end += n;
+            continue;
+        }
+        if (n == 0)
+            co_return;
+
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]]
+            throw std::system_error(errno, std::system_category(), "read_frames: read");
+
+        co_await loop.await_read(fd);
+    }
+}
+
+}
+
+#endif // _RIO_FRAMING_HPP
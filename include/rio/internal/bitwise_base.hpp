@@ -31,6 +31,8 @@ public:
         return n_;
     }
 
+    [[nodiscard]] constexpr bool operator==(bitwise_base const&) const noexcept = default;
+
     [[nodiscard]] explicit operator bool() const noexcept {
         return !!n_;
     }
@@ -0,0 +1,18 @@
+#ifndef _RIO_INTERNAL_FIND_BYTE_HPP
+#define _RIO_INTERNAL_FIND_BYTE_HPP
+
+#include <cstddef>
+
+namespace rio::internal {
+
+// Returns the first occurrence of `value` in [first, last), or `last`.
+// Vectorized with AVX2 or SSE2 on x86-64 (picked at startup from the CPU's
+// features) and NEON on AArch64, with a scalar fallback elsewhere.
+const std::byte* find_byte(const std::byte* first, const std::byte* last, std::byte value) noexcept;
+
+// Name of the implementation find_byte dispatches to ("avx2", "sse2", ...).
+const char* find_byte_impl() noexcept;
+
+}
+
+#endif // _RIO_INTERNAL_FIND_BYTE_HPP
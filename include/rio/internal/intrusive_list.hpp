@@ -0,0 +1,89 @@
+#ifndef _RIO_INTERNAL_INTRUSIVE_LIST_HPP
+#define _RIO_INTERNAL_INTRUSIVE_LIST_HPP
+
+#include <type_traits>
+
+namespace rio::internal {
+
+struct list_node {
+    list_node* prev_ = nullptr;
+    list_node* next_ = nullptr;
+
+    bool is_linked() const noexcept {
+        return next_ != nullptr;
+    }
+
+    // Removes the node from whatever list it is in, without knowing which.
+    void unlink() noexcept {
+        if (!is_linked())
+            return;
+        prev_->next_ = next_;
+        next_->prev_ = prev_;
+        prev_ = next_ = nullptr;
+    }
+};
+
+// Intrusive circular doubly-linked list. Nodes are owned by the caller and
+// unlink themselves, so linking and unlinking never allocate.
+// T may be incomplete where the list is declared.
+template<typename T>
+class intrusive_list {
+public:
+    intrusive_list() noexcept {
+        head_.prev_ = head_.next_ = &head_;
+    }
+
+    intrusive_list(intrusive_list const&) = delete;
+    intrusive_list& operator=(intrusive_list const&) = delete;
+
+    ~intrusive_list() {
+        clear();
+    }
+
+    bool empty() const noexcept {
+        return head_.next_ == &head_;
+    }
+
+    void push_back(T* node) noexcept {
+        static_assert(std::is_base_of_v<list_node, T>);
+        list_node* n = node;
+        n->prev_ = head_.prev_;
+        n->next_ = &head_;
+        head_.prev_->next_ = n;
+        head_.prev_ = n;
+    }
+
+    T* pop_front() noexcept {
+        if (empty())
+            return nullptr;
+        list_node* n = head_.next_;
+        n->unlink();
+        return static_cast<T*>(n);
+    }
+
+    // Moves every node of `other` to the back of this list.
+    void splice(intrusive_list& other) noexcept {
+        if (other.empty())
+            return;
+        list_node* first = other.head_.next_;
+        list_node* last = other.head_.prev_;
+        other.head_.prev_ = other.head_.next_ = &other.head_;
+
+        first->prev_ = head_.prev_;
+        last->next_ = &head_;
+        head_.prev_->next_ = first;
+        head_.prev_ = last;
+    }
+
+    // Unlinks every node, leaving them ready to be linked again.
+    void clear() noexcept {
+        while (pop_front()) { }
+    }
+
+private:
+    list_node head_;
+};
+
+}
+
+#endif // _RIO_INTERNAL_INTRUSIVE_LIST_HPP
@@ -0,0 +1,77 @@
+#ifndef _RIO_INTERNAL_MPSC_QUEUE_HPP
+#define _RIO_INTERNAL_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <type_traits>
+
+namespace rio::internal {
+
+struct mpsc_node {
+    std::atomic<mpsc_node*> next_ { nullptr };
+};
+
+// Intrusive lock-free multi-producer single-consumer queue (Vyukov's).
+// push() may be called from any thread, pop() only from the consumer.
+//
+// pop() may return nullptr while a push() is halfway through, even if other
+// nodes are queued behind it. Callers must make sure the consumer is woken up
+// again once that push() returns.
+template<typename T>
+class mpsc_queue {
+    static_assert(std::is_base_of_v<mpsc_node, T>);
+public:
+    mpsc_queue() noexcept
+        : head_(&stub_), tail_(&stub_) { }
+
+    mpsc_queue(mpsc_queue const&) = delete;
+    mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+    void push(T* node) noexcept {
+        push_node(node);
+    }
+
+    T* pop() noexcept {
+        mpsc_node* tail = tail_;
+        mpsc_node* next = tail->next_.load(std::memory_order_acquire);
+
+        if (tail == &stub_) {
+            if (!next)
+                return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next_.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+
+        if (tail != head_.load(std::memory_order_acquire))
+            return nullptr;
+
+        push_node(&stub_);
+        next = tail->next_.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+
+        return nullptr;
+    }
+
+private:
+    void push_node(mpsc_node* node) noexcept {
+        node->next_.store(nullptr, std::memory_order_relaxed);
+        mpsc_node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next_.store(node, std::memory_order_release);
+    }
+
+    mpsc_node stub_;
+    alignas(64) std::atomic<mpsc_node*> head_;
+    alignas(64) mpsc_node* tail_;
+};
+
+}
+
+#endif // _RIO_INTERNAL_MPSC_QUEUE_HPP
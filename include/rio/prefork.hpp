@@ -0,0 +1,149 @@
+#ifndef _RIO_PREFORK_HPP
+#define _RIO_PREFORK_HPP
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+#include "rio/common/time_type.hpp"
+#include "rio/task.hpp"
+
+namespace rio {
+
+// How the connections of a listener are spread among the workers.
+enum class listener_mode : std::uint8_t {
+    // One socket per worker, all bound to the same address with SO_REUSEPORT:
+    // the kernel balances new connections among them. Inet addresses only.
+    reuseport,
+    // A single socket shared by every worker, which race to accept from it.
+    shared
+};
+
+struct prefork_options {
+    // Number of worker processes, one per CPU when 0.
+    std::size_t workers = 0;
+    listener_mode mode = listener_mode::reuseport;
+    // Delay before a worker that exited on its own is started again.
+    time_type restart_delay = time_type::from_sec(1);
+    // How long draining workers get to exit before they are killed.
+    time_type drain_timeout = time_type::from_sec(30);
+};
+
+// The worker side of a prefork_supervisor, handed to the worker's main.
+class prefork_worker {
+public:
+    // Position of the worker, from 0 to the number of workers. A restarted
+    // worker takes the index, and the listeners, of the one it replaces.
+    std::size_t index() const noexcept {
+        return index_;
+    }
+
+    // Non-blocking listening socket for the i-th add_listener() call.
+    int listener(std::size_t i) const noexcept {
+        return listeners_[i];
+    }
+
+    std::size_t num_listeners() const noexcept {
+        return listeners_.size();
+    }
+
+    // Completes when the supervisor asks the worker to drain, or goes away.
+    // The worker should then stop accepting, finish its connections and
+    // return from its main. Uses the current event loop, whose run() it
+    // keeps alive until then.
+    task<> drain_requested();
+
+private:
+    friend class prefork_supervisor;
+
+    prefork_worker(std::size_t index, std::vector<int> listeners, int control) noexcept
+        : index_(index), listeners_(std::move(listeners)), control_(control) { }
+
+    std::size_t index_;
+    std::vector<int> listeners_;
+    int control_;
+};
+
+// Multi-process server: listeners are created once, then `workers` processes
+// are forked, each running `worker_main` (which typically builds its own
+// event_loop_t, accepts on its listeners and runs the loop). Its return
+// value is the worker's exit status.
+//
+// run() supervises them without an event loop, blocking in sigtimedwait:
+// workers that exit are started again after restart_delay, and SIGTERM or
+// SIGINT drain them through their control sockets, killing whatever is left
+// after drain_timeout (or on a second signal). Workers start with SIGINT and
+// SIGTERM ignored, so a signal sent to the whole process group reaches them
+// through the drain only; their main may install its own handlers.
+//
+// Must be used before any event loop exists in the process.
+class prefork_supervisor {
+public:
+    using worker_main_t = std::function<int(prefork_worker&)>;
+    using exit_handler_t = void(*)(void* ctx, std::size_t index, pid_t pid, int status);
+
+    prefork_supervisor(worker_main_t worker_main, prefork_options options = {});
+    ~prefork_supervisor();
+
+    prefork_supervisor(prefork_supervisor const&) = delete;
+    prefork_supervisor& operator=(prefork_supervisor const&) = delete;
+
+    // Binds and listens on `addr`, returning the listener's index in every
+    // prefork_worker. Must be called before run().
+    std::size_t add_listener(sockaddr const* addr, socklen_t addr_len, int backlog = SOMAXCONN);
+
+    // Port the i-th listener is bound to, useful when binding port 0.
+    std::uint16_t port(std::size_t i) const;
+
+    std::size_t num_workers() const noexcept {
+        return slots_.size();
+    }
+
+    // Called whenever a worker exits, with its waitpid(2) status.
+    void on_worker_exit(exit_handler_t handler, void* ctx) noexcept {
+        exit_handler_ = handler;
+        exit_ctx_ = ctx;
+    }
+
+    // Number of times workers were started again after exiting.
+    std::uint64_t restarts() const noexcept {
+        return restarts_;
+    }
+
+    // Forks the workers and supervises them until they are drained.
+    // Returns in the supervisor only; workers exit with their main's status.
+    void run();
+
+private:
+    struct slot {
+        pid_t pid = -1;
+        int control = -1;
+        time_type restart_at;
+    };
+
+    void start_worker(std::size_t index);
+    [[noreturn]] void run_worker(std::size_t index, int control);
+    void reap(bool draining);
+    void drain();
+    void kill_all() noexcept;
+
+    worker_main_t worker_main_;
+    prefork_options options_;
+
+    // Sockets of each listener: one per worker slot, or one shared by all.
+    std::vector<std::vector<int>> listeners_;
+    std::vector<slot> slots_;
+
+    sigset_t old_mask_;
+    exit_handler_t exit_handler_ = nullptr;
+    void* exit_ctx_ = nullptr;
+    std::uint64_t restarts_ = 0;
+};
+
+}
+
+#endif // _RIO_PREFORK_HPP
@@ -0,0 +1,106 @@
+#ifndef _RIO_PROCESS_HPP
+#define _RIO_PROCESS_HPP
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "rio/task.hpp"
+
+namespace rio {
+
+// How a child's standard stream is set up by spawn().
+enum class stdio_mode {
+    // Shared with the parent.
+    inherit,
+    // Connected to a non-blocking pipe registered in the event loop.
+    pipe,
+    // Redirected to /dev/null.
+    null
+};
+
+struct spawn_options {
+    // Program to run, looked up in PATH if it contains no slash.
+    std::string file;
+    // Arguments, including argv[0]. Defaults to { file } when empty.
+    std::vector<std::string> args;
+    // Environment as "NAME=value" strings. Inherited when empty.
+    std::vector<std::string> env;
+
+    stdio_mode stdin_mode = stdio_mode::inherit;
+    stdio_mode stdout_mode = stdio_mode::inherit;
+    stdio_mode stderr_mode = stdio_mode::inherit;
+};
+
+// A child process whose exit is observed through a pidfd registered in the
+// event loop, so waiting on many children needs no thread and no SIGCHLD.
+// Only its own child is ever reaped. Destroying the object while the child
+// still runs kills the child with SIGKILL without waiting for it: the event
+// loop reaps it once it is gone, so it can't linger as a zombie. Without an
+// event loop the destructor blocks until the child is reaped. To choose the
+// signal, or to know when the child is gone, kill() and co_await wait().
+class process {
+public:
+    process() noexcept = default;
+    ~process();
+
+    process(process const&) = delete;
+    process& operator=(process const&) = delete;
+
+    process(process&& other) noexcept;
+    process& operator=(process&& other) noexcept;
+
+    pid_t pid() const noexcept {
+        return pid_;
+    }
+
+    // Parent ends of the pipes requested in spawn_options, or -1. They are
+    // non-blocking and registered in the event loop (stdin as writable,
+    // stdout and stderr as readable), and owned by the process object.
+    int stdin_fd() const noexcept {
+        return stdin_;
+    }
+
+    int stdout_fd() const noexcept {
+        return stdout_;
+    }
+
+    int stderr_fd() const noexcept {
+        return stderr_;
+    }
+
+    // Closes the child's stdin pipe, so it sees end of file.
+    void close_stdin() noexcept;
+
+    // Sends `signo` to the child through its pidfd.
+    void kill(int signo);
+
+    // Waits for the child to exit and reaps it. Returns the wait status, as
+    // waitpid(2) does (see WIFEXITED and friends).
+    task<int> wait();
+
+    bool exited() const noexcept {
+        return exited_;
+    }
+
+private:
+    friend task<process> spawn(spawn_options options);
+
+    static void close_fd(int& fd) noexcept;
+    static bool hand_to_loop(int pidfd) noexcept;
+    void reset() noexcept;
+
+    pid_t pid_ = -1;
+    int pidfd_ = -1;
+    int stdin_ = -1;
+    int stdout_ = -1;
+    int stderr_ = -1;
+    int status_ = 0;
+    bool exited_ = false;
+};
+
+// Starts a child process with posix_spawn. See spawn_options.
+task<process> spawn(spawn_options options);
+
+}
+
+#endif // _RIO_PROCESS_HPP
@@ -5,7 +5,9 @@
 #include <exception>
 #include <vector>
 #include "rio/internal/bitwise_base.hpp"
+#include "rio/common/errc.hpp"
 #include "rio/common/time_type.hpp"
+#include "rio/common/trigger_mode.hpp"
 
 namespace rio {
 
@@ -35,21 +37,44 @@ public:
     selector(selector&& other) noexcept;
     selector& operator=(selector&&) noexcept;
 
-    void add_fd(int fd, events ev);
+    // Kernel-side busy polling of the sockets in this selector (EPIOCSPARAMS,
+    // Linux 6.9+): spin for up to `usecs` handling at most `budget` packets
+    // per poll, `prefer` asks the driver to keep interrupts deferred.
+    void set_busy_poll(std::uint32_t usecs, std::uint16_t budget, bool prefer);
+
+    // `tag` is stored in the kernel next to the fd and reported back with its
+    // events, see event_data.
+    void add_fd(int fd, events ev, trigger_mode mode = trigger_mode::edge, std::uint32_t tag = 0);
+    // Replaces the interest set, trigger mode and tag of a registered fd,
+    // also re-arming it if it was registered as oneshot.
+    void modify_fd(int fd, events ev, trigger_mode mode = trigger_mode::edge, std::uint32_t tag = 0);
     void del_fd(int fd);
     int wait(std::vector<event_data>& data);
     int wait(std::vector<event_data>& data, time_type timeout);
 
+    // Same as above, but epoll_ctl/epoll_pwait2 errors are returned instead
+    // of thrown. Using an uninitialized selector still throws.
+    result<> try_add_fd(int fd, events ev, trigger_mode mode = trigger_mode::edge, std::uint32_t tag = 0);
+    result<> try_modify_fd(int fd, events ev, trigger_mode mode = trigger_mode::edge, std::uint32_t tag = 0);
+    result<> try_del_fd(int fd);
+    result<int> try_wait(std::vector<event_data>& data);
+    result<int> try_wait(std::vector<event_data>& data, time_type timeout);
+
     std::size_t get_num_events() const noexcept {
         return num_events_;
     }
 
+    // The epoll fd, readable while events are pending. -1 if uninitialized.
+    int native_handle() const noexcept {
+        return epfd_;
+    }
+
     void destroy() noexcept;
     ~selector();
 
 private:
     [[noreturn]] static void throw_bad_selector_access();
-    int _wait(std::vector<event_data>& data, std::timespec* timeout);
+    result<int> _wait(std::vector<event_data>& data, std::timespec* timeout);
 
     void throw_if_unitialized() {
         if (epfd_ == -1)
@@ -72,15 +97,23 @@ public:
     static const events none;
     static const events input;
     static const events output;
+    // EPOLLERR: the fd has a pending error or error-queue message. Always
+    // reported along with input and output, and regardless of the interest set.
+    static const events error;
 };
 
 constexpr selector::events selector::events::none   { 0x00 };
 constexpr selector::events selector::events::input  { 0x01 };
 constexpr selector::events selector::events::output { 0x02 };
+constexpr selector::events selector::events::error  { 0x04 };
 
 struct selector::event_data {
     int fd;
     events flags;
+    // Tag of the registration the events were reported for. An event read
+    // before the fd number was deleted and registered again carries the old
+    // registration's tag.
+    std::uint32_t tag = 0;
 };
 
 }
@@ -0,0 +1,112 @@
+#ifndef _RIO_SHM_RING_HPP
+#define _RIO_SHM_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include "rio/task.hpp"
+
+namespace rio {
+
+// Single-producer single-consumer message ring in shared memory, for IPC
+// between processes on the same host without a syscall or a copy through
+// the kernel per message.
+//
+// The ring lives in a memfd mapped twice back to back, so every message is
+// contiguous and recv() can return it in place. Head and tail sit on their
+// own cache lines. Each direction of wakeup has an eventfd, registered in
+// the loop of whichever process waits on it: the producer only signals the
+// consumer when the ring goes from empty to non-empty, and the consumer only
+// signals the producer if it is waiting for space.
+//
+// One process creates the ring and hands the three fds to the other, by
+// fork() or over a Unix socket, which attaches to them. Waiting registers
+// an eventfd in the event loop, where it stays until the ring is destroyed.
+class shm_ring {
+public:
+    shm_ring() noexcept = default;
+    ~shm_ring();
+
+    shm_ring(shm_ring const&) = delete;
+    shm_ring& operator=(shm_ring const&) = delete;
+
+    shm_ring(shm_ring&& other) noexcept;
+    shm_ring& operator=(shm_ring&& other) noexcept;
+
+    // A new ring of at least `capacity` bytes, rounded up to a power of two
+    // and to whole pages.
+    static shm_ring create(std::size_t capacity);
+
+    // Takes ownership of the fds of a ring created by another process.
+    static shm_ring attach(int memfd, int data_efd, int space_efd);
+
+    int memfd() const noexcept {
+        return memfd_;
+    }
+
+    // Signalled by the producer for the consumer.
+    int data_eventfd() const noexcept {
+        return data_efd_;
+    }
+
+    // Signalled by the consumer for the producer.
+    int space_eventfd() const noexcept {
+        return space_efd_;
+    }
+
+    std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    // Largest message send() accepts.
+    std::size_t max_message_size() const noexcept;
+
+    // Producer side. Copies `msg` into the ring, suspending while it is full.
+    // Throws std::system_error (EPIPE) if the ring was shut down.
+    task<> send(std::span<const std::byte> msg);
+    bool try_send(std::span<const std::byte> msg);
+
+    // Consumer side. The next message, in place in the ring: it stays valid
+    // until the next recv() or release(). Suspends while the ring is empty,
+    // and completes with nullopt once it is empty and shut down. Throws
+    // std::system_error (EBADMSG) if the ring holds a corrupt record.
+    task<std::optional<std::span<const std::byte>>> recv();
+    std::optional<std::span<const std::byte>> try_recv();
+
+    // Gives the space of the last received message back to the producer.
+    void release() noexcept;
+
+    // Marks the ring closed for both ends and wakes them up. Messages
+    // already sent can still be received.
+    void shutdown() noexcept;
+
+private:
+    struct header;
+
+    shm_ring(int memfd, int data_efd, int space_efd);
+
+    static void signal(int efd) noexcept;
+    void drain(int efd, bool& registered);
+    bool closed() const noexcept;
+    void reset() noexcept;
+
+    int memfd_ = -1;
+    int data_efd_ = -1;
+    int space_efd_ = -1;
+
+    void* mapping_ = nullptr;
+    std::size_t mapping_size_ = 0;
+    header* header_ = nullptr;
+    std::byte* data_ = nullptr;
+    std::size_t capacity_ = 0;
+
+    // Size of the received message not released yet.
+    std::size_t pending_ = 0;
+    bool data_registered_ = false;
+    bool space_registered_ = false;
+};
+
+}
+
+#endif // _RIO_SHM_RING_HPP
@@ -0,0 +1,79 @@
+#ifndef _RIO_SIMULATION_HPP
+#define _RIO_SIMULATION_HPP
+
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "rio/common/time_type.hpp"
+#include "rio/common/trigger_mode.hpp"
+#include "rio/selector.hpp"
+
+namespace rio {
+
+// Deterministic simulated time for an event loop, see
+// event_loop_t::event_loop_t(simulation&).
+//
+// The loop reads time from a virtual clock and uses an in-memory selector in
+// place of epoll: waiting with a timeout jumps the clock straight to the
+// deadline, and readiness is whatever the test injects. Runs are therefore
+// instant and replay exactly. Work posted to the loop runs at its next
+// iteration, without the clock moving; other sources outside the loop
+// (signals, the blocking I/O pool...) are not delivered.
+class simulation {
+public:
+    explicit simulation(time_type start = {}) noexcept
+        : now_(start) { }
+
+    simulation(simulation const&) = delete;
+    simulation& operator=(simulation const&) = delete;
+
+    time_type now() const noexcept {
+        return now_;
+    }
+
+    // Moves the virtual clock forward; it never goes back.
+    void advance(time_type delta) noexcept {
+        if (delta.as_ns() > 0)
+            now_ += delta;
+    }
+
+    // Makes `fd` ready for `ev`. The readiness is reported by the next wait
+    // once the fd is interested in it, and only once whatever its trigger
+    // mode is. Oneshot fds are disarmed by the report, like with epoll.
+    // An error is reported at once, as every direction.
+    void inject(int fd, selector::events ev);
+
+    bool is_registered(int fd) const noexcept {
+        return fds_.contains(fd);
+    }
+
+    std::size_t get_num_events() const noexcept {
+        return fds_.size();
+    }
+
+    // selector interface, used by the loop.
+    void add_fd(int fd, selector::events ev, trigger_mode mode, std::uint32_t tag = 0);
+    void modify_fd(int fd, selector::events ev, trigger_mode mode, std::uint32_t tag = 0);
+    void del_fd(int fd);
+
+    // Never blocks: reports the injected events, or advances the clock by
+    // `timeout` if there are none. Waiting without a timeout and without
+    // events can never finish, so it throws simulation_stalled_exception.
+    int wait(std::vector<selector::event_data>& data, std::optional<time_type> timeout);
+
+private:
+    struct registration {
+        selector::events interest;
+        trigger_mode mode;
+        std::uint32_t tag;
+    };
+
+    std::unordered_map<int, registration> fds_;
+    std::vector<selector::event_data> pending_;
+    time_type now_;
+};
+
+}
+
+#endif // _RIO_SIMULATION_HPP
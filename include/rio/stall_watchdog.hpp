@@ -0,0 +1,106 @@
+#ifndef _RIO_STALL_WATCHDOG_HPP
+#define _RIO_STALL_WATCHDOG_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "rio/common/time_type.hpp"
+
+namespace rio {
+
+class event_loop_t;
+
+struct stall_report {
+    // Code that blocked the loop: the scheduled function or fd callback, or
+    // the resume function of the coroutine.
+    void* source;
+    // How long it had been running when the stall was detected.
+    time_type duration;
+    // Return addresses of the loop thread at detection, innermost first.
+    // Empty if the sample couldn't be taken before the dispatch finished.
+    std::vector<void*> stack;
+};
+
+// Flags single dispatches (a coroutine step, a scheduled function or an fd
+// callback) that keep the loop busy for longer than `threshold`.
+//
+// The loop only bumps a heartbeat around each dispatch. A helper thread
+// checks it every threshold / 4, and when one dispatch outlives the
+// threshold it samples the loop thread's stack by sending it `sample_signal`
+// (whose handler calls backtrace()), counts the stall by source and hands
+// the report to the handler, on the helper thread.
+//
+// Must be created on the loop thread, at most one per process, and
+// `sample_signal` must not be blocked on the loop thread (e.g. watched with
+// event_loop_t::signal).
+class stall_watchdog {
+public:
+    using stall_handler_t = void(*)(void* ctx, stall_report const& report);
+
+    stall_watchdog(event_loop_t& loop, time_type threshold, int sample_signal = SIGURG);
+    ~stall_watchdog();
+
+    stall_watchdog(stall_watchdog const&) = delete;
+    stall_watchdog& operator=(stall_watchdog const&) = delete;
+
+    // Called on the watchdog thread for every stall.
+    void on_stall(stall_handler_t handler, void* ctx);
+
+    // Number of stalls seen, by source.
+    std::vector<std::pair<void*, std::uint64_t>> stall_counts() const;
+    std::uint64_t total_stalls() const;
+
+    // Loop side, around each dispatch. The heartbeat is odd while dispatching,
+    // and every dispatch gets a beat of its own. The parity is set rather than
+    // flipped, so a leave() skipped by an exception can't invert it.
+    void enter(void* source) noexcept {
+        // Orders the fields after the previous beat, see watch().
+        std::atomic_thread_fence(std::memory_order_release);
+        source_.store(source, std::memory_order_relaxed);
+        entered_at_.store(time_type::monotonic_clock().as_ns(), std::memory_order_relaxed);
+        auto beat = heartbeat_.load(std::memory_order_relaxed);
+        heartbeat_.store((beat + 1) | 1, std::memory_order_release);
+    }
+
+    void leave() noexcept {
+        auto beat = heartbeat_.load(std::memory_order_relaxed);
+        heartbeat_.store((beat + 1) & ~std::uint64_t { 1 }, std::memory_order_release);
+    }
+
+private:
+    void watch();
+    void report(void* source, time_type duration, std::uint64_t beat);
+    std::vector<void*> sample_stack(std::uint64_t beat);
+
+    event_loop_t& loop_;
+    time_type threshold_;
+    int sample_signal_;
+    pthread_t loop_thread_;
+    struct sigaction old_action_;
+
+    std::atomic<std::uint64_t> heartbeat_ { 0 };
+    std::atomic<void*> source_ { nullptr };
+    // When the current dispatch started, in monotonic_clock nanoseconds.
+    std::atomic<std::int64_t> entered_at_ { 0 };
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    stall_handler_t handler_ = nullptr;
+    void* handler_ctx_ = nullptr;
+    std::unordered_map<void*, std::uint64_t> counts_;
+    std::uint64_t total_ = 0;
+
+    std::thread thread_;
+};
+
+}
+
+#endif // _RIO_STALL_WATCHDOG_HPP
@@ -0,0 +1,118 @@
+#ifndef _RIO_UDP_HPP
+#define _RIO_UDP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <sys/socket.h>
+#include "rio/task.hpp"
+
+namespace rio {
+
+// Preallocated message vectors for recvmmsg/sendmmsg.
+//
+// A batch owns `capacity` slots, each with its own payload buffer, address
+// and control buffer, so receiving or sending a batch does not allocate.
+// When UDP_GRO is enabled a single slot may hold several coalesced datagrams
+// of `segment_size(i)` bytes each, so `buffer_size` should be large enough
+// (up to 64KiB) to hold a whole GRO super-packet.
+class udp_batch {
+public:
+    udp_batch(std::size_t capacity, std::size_t buffer_size);
+    ~udp_batch();
+
+    udp_batch(udp_batch const&) = delete;
+    udp_batch& operator=(udp_batch const&) = delete;
+
+    udp_batch(udp_batch&&) noexcept;
+    udp_batch& operator=(udp_batch&&) noexcept;
+
+    std::size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    std::size_t buffer_size() const noexcept {
+        return buffer_size_;
+    }
+
+    // Number of messages received by the last recv, or queued for the next send.
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    bool full() const noexcept {
+        return size_ == capacity_;
+    }
+
+    void clear() noexcept {
+        size_ = 0;
+    }
+
+    // Payload of the i-th message.
+    std::span<std::byte> data(std::size_t i) const noexcept;
+
+    sockaddr const* address(std::size_t i) const noexcept;
+    socklen_t address_len(std::size_t i) const noexcept;
+
+    // GRO segment size of the i-th received message, 0 if it was not coalesced.
+    std::uint16_t segment_size(std::size_t i) const noexcept;
+
+    // Whether the i-th received message was longer than buffer_size() and
+    // its tail was discarded (MSG_TRUNC).
+    bool truncated(std::size_t i) const noexcept;
+
+    // Copies a datagram into the next free slot. A non-zero segment_size asks
+    // the kernel to split the payload into segments of that size (UDP GSO).
+    // Returns false if the batch is full or the payload does not fit a slot.
+    bool push(std::span<const std::byte> payload,
+              sockaddr const* addr = nullptr, socklen_t addr_len = 0,
+              std::uint16_t segment_size = 0) noexcept;
+
+private:
+    struct slot;
+
+    friend task<std::size_t> async_recv_batch(int fd, udp_batch& batch);
+    friend task<std::size_t> async_send_batch(int fd, udp_batch& batch);
+
+    void prepare_recv() noexcept;
+    void finish_recv(std::size_t n) noexcept;
+    void drop_front(std::size_t n) noexcept;
+
+    std::size_t capacity_;
+    std::size_t buffer_size_;
+    std::size_t size_;
+
+    std::unique_ptr<slot[]> slots_;
+    std::unique_ptr<mmsghdr[]> msgs_;
+    std::unique_ptr<std::byte[]> buffers_;
+};
+
+// Receives up to `batch.capacity()` datagrams with a single recvmmsg call,
+// suspending on the loop until the fd is readable if nothing is queued.
+// The fd must be non-blocking and registered in the event loop as readable.
+task<std::size_t> async_recv_batch(int fd, udp_batch& batch);
+
+// Sends every message queued in `batch` using as few sendmmsg calls as
+// possible, suspending on the loop while the socket buffer is full. The batch
+// is cleared once everything was sent. If sending fails after some messages
+// went out, returns how many and drops them from the batch, which then starts
+// with the message that failed: calling async_send_batch again resumes
+// sending, and throws that message's error. The error is only thrown when
+// none was sent. The fd must be non-blocking and registered in the event
+// loop as writable.
+task<std::size_t> async_send_batch(int fd, udp_batch& batch);
+
+// Sets the default UDP_SEGMENT (GSO) size for every send on `fd`, 0 disables it.
+void set_udp_gso(int fd, std::uint16_t segment_size);
+
+// Enables or disables UDP_GRO on `fd`.
+void set_udp_gro(int fd, bool enabled);
+
+}
+
+#endif // _RIO_UDP_HPP
@@ -0,0 +1,29 @@
+#ifndef _RIO_ZEROCOPY_HPP
+#define _RIO_ZEROCOPY_HPP
+
+#include <cstddef>
+#include <span>
+#include "rio/task.hpp"
+
+namespace rio {
+
+// Sends below this size are copied: pinning pages and reaping the completion
+// costs more than the copy for them.
+inline constexpr std::size_t zerocopy_min_size = 16 * 1024;
+
+// Enables SO_ZEROCOPY on `fd`, required before any MSG_ZEROCOPY send.
+// Returns false if the kernel doesn't support it for the socket.
+bool set_zerocopy(int fd, bool enabled = true);
+
+// Sends all of `buf` on a stream socket with MSG_ZEROCOPY, suspending while
+// the socket buffer is full, and completes only once the kernel reported
+// every zerocopy send of it complete, so `buf` must stay untouched until then.
+// Small sends, sends on sockets without SO_ZEROCOPY enabled, and sends on
+// sockets where the kernel had to copy anyway use a plain send instead. The
+// fd must be non-blocking and registered in the event loop as writable.
+task<std::size_t> async_send_zerocopy(int fd, std::span<const std::byte> buf,
+                                      std::size_t min_size = zerocopy_min_size);
+
+}
+
+#endif // _RIO_ZEROCOPY_HPP
@@ -0,0 +1,78 @@
+#include "rio/async_file.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+#include "rio/event_loop.hpp"
+
+namespace rio {
+
+std::size_t async_file::awaiter::await_resume() const {
+    if (req_.result == -1) [[unlikely]]
+        throw std::system_error(req_.error, std::system_category(), what_);
+    return static_cast<std::size_t>(req_.result);
+}
+
+async_file::async_file(int fd)
+    : fd_(fd), pool_(&get_event_loop().io_pool()) { }
+
+task<async_file> async_file::open(const char* path, int flags, mode_t mode) {
+    blocking_io_pool::request req;
+    req.type = blocking_io_pool::op::open;
+    req.fd = -1;
+    req.buf = const_cast<char*>(path);
+    req.flags = flags | O_CLOEXEC;
+    req.mode = mode;
+
+    auto& pool = get_event_loop().io_pool();
+    int fd = static_cast<int>(co_await awaiter { pool, req, "async_file: open" });
+
+    async_file file;
+    file.fd_ = fd;
+    file.pool_ = &pool;
+    co_return file;
+}
+
+async_file::~async_file() {
+    close();
+}
+
+async_file::async_file(async_file&& other) noexcept
+    : fd_(other.fd_), pool_(other.pool_)
+{
+    other.fd_ = -1;
+}
+
+async_file& async_file::operator=(async_file&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = other.fd_;
+        pool_ = other.pool_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+void async_file::close() noexcept {
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+async_file::awaiter async_file::make_awaiter(blocking_io_pool::op type, void* buf,
+                                             std::size_t len, off_t offset, int advice) {
+    if (!pool_) [[unlikely]]
+        throw std::system_error(EBADF, std::system_category(), "async_file");
+
+    blocking_io_pool::request req;
+    req.type = type;
+    req.fd = fd_;
+    req.buf = buf;
+    req.len = len;
+    req.offset = offset;
+    req.advice = advice;
+    return awaiter { *pool_, req };
+}
+
+}
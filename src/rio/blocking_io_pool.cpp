@@ -0,0 +1,281 @@
+#include "rio/blocking_io_pool.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include "rio/event_loop.hpp"
+#include "tsl/macros.hpp"
+
+using std::size_t;
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Upper bound on how many adjacent requests are merged into one syscall.
+constexpr size_t MAX_BATCH = 64;
+
+blocking_io_pool::blocking_io_pool(event_loop_t& loop, size_t max_threads)
+    : loop_(loop), max_threads_(max_threads)
+{
+    if (max_threads_ == 0)
+        throw std::invalid_argument("blocking_io_pool: max_threads must be > 0");
+
+    efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd_ == -1)
+        THROW_ERRNO("blocking_io_pool: eventfd");
+
+    try {
+        loop_.add_fd(efd_, file_ops::readable, on_completion, this);
+    } catch (...) {
+        ::close(efd_);
+        throw;
+    }
+}
+
+blocking_io_pool::~blocking_io_pool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+
+    // Requests no thread will run are failed with ECANCELED, or their
+    // coroutines would stay suspended forever. Those resumed may submit more.
+    while (!queue_.empty() || done_head_) {
+        for (request* req : std::exchange(queue_, {})) {
+            req->result = -1;
+            req->error = ECANCELED;
+            req->next = nullptr;
+            complete(req);
+        }
+        resume_completed();
+    }
+
+    loop_.del_fd(efd_);
+    ::close(efd_);
+}
+
+void blocking_io_pool::set_max_threads(size_t max_threads) {
+    if (max_threads == 0)
+        throw std::invalid_argument("blocking_io_pool: max_threads must be > 0");
+
+    std::lock_guard lock(mutex_);
+    max_threads_ = max_threads;
+}
+
+void blocking_io_pool::submit(request& req) {
+    req.next = nullptr;
+    loop_.ref();
+
+    {
+        std::lock_guard lock(mutex_);
+        queue_.push_back(&req);
+
+        // Idle threads already woken may not have taken their request yet.
+        if (!stop_ && queue_.size() > idle_threads_ && threads_.size() < max_threads_)
+            start_thread();
+    }
+    cv_.notify_one();
+}
+
+void blocking_io_pool::start_thread() {
+    // Workers inherit the mask, and with every signal blocked they can't
+    // take signals meant for the loop thread (signalfd, on_signal...).
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    try {
+        threads_.emplace_back(&blocking_io_pool::worker, this);
+    } catch (...) {
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+        throw;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+void blocking_io_pool::worker() {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        idle_threads_++;
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        idle_threads_--;
+        if (stop_)
+            return;
+
+        request* first = queue_.front();
+        queue_.pop_front();
+
+        // Merge the queued requests that continue this one into a chain.
+        request* last = first;
+        if (first->type == op::read || first->type == op::write) {
+            size_t count = 1;
+            for (auto it = queue_.begin(); it != queue_.end() && count < MAX_BATCH;) {
+                request* req = *it;
+                if (req->type == first->type && req->fd == first->fd
+                    && req->offset == last->offset + static_cast<off_t>(last->len)) {
+                    last->next = req;
+                    last = req;
+                    count++;
+                    queue_.erase(it);
+                    it = queue_.begin();
+                } else {
+                    ++it;
+                }
+            }
+        }
+        last->next = nullptr;
+
+        lock.unlock();
+        execute(first);
+        complete(first);
+        lock.lock();
+    }
+}
+
+static void run_single(blocking_io_pool::request& req) {
+    using op = blocking_io_pool::op;
+
+    ssize_t r = -1;
+    int err = 0;
+    switch (req.type) {
+    case op::read:
+        r = ::pread(req.fd, req.buf, req.len, req.offset);
+        break;
+    case op::write:
+        r = ::pwrite(req.fd, req.buf, req.len, req.offset);
+        break;
+    case op::fsync:
+        r = ::fsync(req.fd);
+        break;
+    case op::fdatasync:
+        r = ::fdatasync(req.fd);
+        break;
+    case op::fadvise:
+        // posix_fadvise returns the error instead of setting errno.
+        err = ::posix_fadvise(req.fd, req.offset, static_cast<off_t>(req.len), req.advice);
+        r = err ? -1 : 0;
+        errno = err;
+        break;
+    case op::readahead:
+        r = ::readahead(req.fd, req.offset, req.len);
+        break;
+    case op::open:
+        r = ::open(static_cast<const char*>(req.buf), req.flags, req.mode);
+        break;
+    }
+
+    req.result = r;
+    req.error = r == -1 ? errno : 0;
+}
+
+void blocking_io_pool::execute(request* batch) {
+    if (!batch->next) {
+        run_single(*batch);
+        return;
+    }
+
+    iovec iov[MAX_BATCH];
+    size_t count = 0;
+    size_t total = 0;
+    for (request* req = batch; req; req = req->next) {
+        iov[count++] = { req->buf, req->len };
+        total += req->len;
+    }
+
+    ssize_t r = batch->type == op::read
+        ? ::preadv(batch->fd, iov, static_cast<int>(count), batch->offset)
+        : ::pwritev(batch->fd, iov, static_cast<int>(count), batch->offset);
+
+    if (r == -1) {
+        // Let every request report its own error.
+        for (request* req = batch; req; req = req->next)
+            run_single(*req);
+        return;
+    }
+
+    // Split the result between the requests. Short transfers past the first
+    // request are retried on their own, so that they see exactly what a
+    // separate pread/pwrite would have.
+    size_t remaining = static_cast<size_t>(r);
+    for (request* req = batch; req; req = req->next) {
+        if (remaining >= req->len) {
+            req->result = static_cast<ssize_t>(req->len);
+            req->error = 0;
+            remaining -= req->len;
+        } else if (req == batch) {
+            req->result = static_cast<ssize_t>(remaining);
+            req->error = 0;
+            remaining = 0;
+        } else {
+            run_single(*req);
+            remaining = 0;
+        }
+    }
+}
+
+void blocking_io_pool::complete(request* batch) {
+    request* last = batch;
+    while (last->next)
+        last = last->next;
+
+    bool notify;
+    {
+        std::lock_guard lock(done_mutex_);
+        notify = done_head_ == nullptr;
+        if (done_tail_)
+            done_tail_->next = batch;
+        else
+            done_head_ = batch;
+        done_tail_ = last;
+    }
+
+    // The loop drains the whole list on each wakeup, so only the transition
+    // from empty needs to be signaled.
+    if (notify) {
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto r = ::write(efd_, &one, sizeof(one));
+    }
+}
+
+void blocking_io_pool::on_completion(void* ctx, selector::events) {
+    auto& pool = *static_cast<blocking_io_pool*>(ctx);
+
+    std::uint64_t value;
+    [[maybe_unused]] auto r = ::read(pool.efd_, &value, sizeof(value));
+    pool.resume_completed();
+}
+
+void blocking_io_pool::resume_completed() {
+    request* req;
+    {
+        std::lock_guard lock(done_mutex_);
+        req = done_head_;
+        done_head_ = done_tail_ = nullptr;
+    }
+
+    while (req) {
+        // The coroutine may destroy the request, so read next first.
+        request* next = req->next;
+        loop_.unref();
+        req->coro.resume();
+        req = next;
+    }
+}
+
+}
@@ -0,0 +1,110 @@
+#include "rio/buffer_pool.hpp"
+
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include "rio/event_loop.hpp"
+#include "tsl/macros.hpp"
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Cache-line aligned, so neighbouring buffers never share a line.
+static constexpr std::align_val_t BUFFER_ALIGNMENT { 64 };
+
+buffer_pool::buffer_pool(std::size_t buffer_size, std::size_t max_free)
+    : buffer_size_(buffer_size), max_free_(max_free)
+{
+    // Free buffers store the free list's link in themselves.
+    if (buffer_size_ < sizeof(free_buffer))
+        throw std::invalid_argument("buffer_pool: buffer_size is too small");
+}
+
+buffer_pool::~buffer_pool() {
+    TSL_ASSERT(leased_ == 0);
+    trim();
+}
+
+buffer_lease buffer_pool::acquire() {
+    std::byte* buffer;
+    if (free_) {
+        auto node = free_;
+        free_ = node->next;
+        num_free_--;
+        buffer = reinterpret_cast<std::byte*>(node);
+    } else {
+        buffer = static_cast<std::byte*>(::operator new(buffer_size_, BUFFER_ALIGNMENT));
+    }
+
+    leased_++;
+    return { this, buffer, buffer_size_ };
+}
+
+void buffer_pool::give_back(std::byte* buffer) noexcept {
+    TSL_ASSERT(leased_ > 0);
+    leased_--;
+
+    if (num_free_ >= max_free_) {
+        ::operator delete(buffer, BUFFER_ALIGNMENT);
+        return;
+    }
+
+    free_ = new (buffer) free_buffer { free_ };
+    num_free_++;
+}
+
+void buffer_pool::set_max_free(std::size_t max_free) noexcept {
+    max_free_ = max_free;
+    while (num_free_ > max_free_) {
+        auto node = free_;
+        free_ = node->next;
+        num_free_--;
+        ::operator delete(node, BUFFER_ALIGNMENT);
+    }
+}
+
+void buffer_pool::trim() noexcept {
+    auto max_free = max_free_;
+    set_max_free(0);
+    max_free_ = max_free;
+}
+
+task<buffer_lease> async_read_pooled(int fd, buffer_pool& pool) {
+    auto& loop = get_event_loop();
+
+    for (;;) {
+        // A buffer is only taken when a read may succeed, and given back
+        // right away when it doesn't.
+        if (loop.readiness(fd) & file_ops::readable) {
+            auto lease = pool.acquire();
+            ssize_t n = ::read(fd, lease.data().data(), lease.size());
+            if (n > 0) {
+                lease.truncate(static_cast<std::size_t>(n));
+                co_return lease;
+            }
+            if (n == 0)
+                co_return buffer_lease {};
+
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                THROW_ERRNO("async_read_pooled: read");
+
+            lease.release();
+        }
+
+        co_await loop.await_read(fd);
+    }
+}
+
+task<buffer_lease> async_read_pooled(int fd) {
+    return async_read_pooled(fd, get_event_loop().buffers());
+}
+
+}
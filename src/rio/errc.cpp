@@ -0,0 +1,41 @@
+#include "rio/common/errc.hpp"
+
+#include <string>
+
+namespace rio {
+
+namespace {
+
+class rio_category_t : public std::error_category {
+public:
+    const char* name() const noexcept override {
+        return "rio";
+    }
+
+    std::string message(int ev) const override {
+        switch (static_cast<errc>(ev)) {
+        case errc::fd_out_of_range:
+            return "fd is out of range";
+        case errc::fd_not_registered:
+            return "fd is not registered";
+        case errc::fd_already_registered:
+            return "fd is already registered";
+        case errc::fd_not_readable:
+            return "fd is not readable";
+        case errc::fd_not_writable:
+            return "fd is not writable";
+        case errc::fd_dispatched_to_callback:
+            return "fd is dispatched to a callback";
+        }
+        return "unknown rio error";
+    }
+};
+
+}
+
+std::error_category const& rio_category() noexcept {
+    static const rio_category_t category;
+    return category;
+}
+
+}
@@ -6,10 +6,16 @@
 #include <sys/resource.h>
 #include <system_error>
 #include <cstring>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <format>
 #include <memory>
 #include "rio/common/bad_file_descriptor.hpp"
+#include "rio/blocking_io_pool.hpp"
+#include "rio/buffer_pool.hpp"
+#include "rio/simulation.hpp"
+#include "rio/stall_watchdog.hpp"
 
 #define INLINE extern inline
 
@@ -37,15 +43,87 @@ static size_t get_proc_max_fileno() {
 
 event_loop_t::event_loop_t(): event_loop_t(get_proc_max_fileno()) {}
 
+static selector::events to_selector_events(file_ops ops) noexcept {
+    selector::events events = selector::events::none;
+    if (ops & file_ops::readable)
+        events |= selector::events::input;
+    if (ops & file_ops::writable)
+        events |= selector::events::output;
+    return events;
+}
+
+static file_ops to_file_ops(selector::events events) noexcept {
+    file_ops ops = file_ops::none;
+    if (events & selector::events::input)
+        ops |= file_ops::readable;
+    if (events & selector::events::output)
+        ops |= file_ops::writable;
+    return ops;
+}
+
+// Brackets one dispatch for the stall watchdog, leaving it on every way out,
+// exceptions included. The watchdog may go away during the dispatch.
+class event_loop_t::watchdog_scope {
+public:
+    watchdog_scope(event_loop_t& loop, void* source) noexcept
+        : loop_(loop)
+    {
+        if (loop_.watchdog_) [[unlikely]]
+            loop_.watchdog_->enter(source);
+    }
+
+    ~watchdog_scope() {
+        if (loop_.watchdog_) [[unlikely]]
+            loop_.watchdog_->leave();
+    }
+
+    watchdog_scope(watchdog_scope const&) = delete;
+    watchdog_scope& operator=(watchdog_scope const&) = delete;
+
+private:
+    event_loop_t& loop_;
+};
+
+// Exceptions of the throwing API for the errors of the try_* functions, the
+// same the loop threw before they existed. Errors from the selector are
+// thrown as std::system_error with `what`.
+void event_loop_t::throw_fd_error(std::error_code ec, int fd, const char* what) {
+    if (ec.category() != rio_category())
+        throw std::system_error(ec, what);
+
+    switch (static_cast<errc>(ec.value())) {
+    case errc::fd_out_of_range:
+        throw std::out_of_range(std::format("fd {} is out of range", fd));
+    case errc::fd_already_registered:
+        throw std::invalid_argument(std::format("fd {} is already registered", fd));
+    case errc::fd_not_registered:
+        throw bad_file_descriptor(std::format("fd {} is not registered", fd));
+    case errc::fd_not_readable:
+        throw bad_file_descriptor(std::format("fd {} is not readable", fd));
+    case errc::fd_not_writable:
+        throw bad_file_descriptor(std::format("fd {} is not writable", fd));
+    case errc::fd_dispatched_to_callback:
+        throw bad_file_descriptor(std::format("fd {} is dispatched to a callback", fd));
+    }
+    throw std::system_error(ec, what);
+}
+
+INLINE std::error_code event_loop_t::check_fd(int fd) const noexcept {
+    if (fd < 0 || static_cast<size_t>(fd) >= max_fileno_)
+        return errc::fd_out_of_range;
+    if (!files_[fd].is_valid())
+        return errc::fd_not_registered;
+    return {};
+}
+
 INLINE void event_loop_t::ensure_fd_in_range(int fd) const {
     if (fd < 0 || static_cast<size_t>(fd) >= max_fileno_)
         throw std::out_of_range(std::format("fd {} is out of range", fd));
 }
 
-INLINE void event_loop_t::ensure_fd_registered(int fd) const {
-    ensure_fd_in_range(fd);
-    if (!files_[fd].is_valid())
-        throw bad_file_descriptor(std::format("fd {} is not registered", fd));
+void event_loop_t::ensure_fd_registered(int fd) const {
+    if (auto ec = check_fd(fd)) [[unlikely]]
+        throw_fd_error(ec, fd);
 }
 
 template <typename T>
@@ -66,7 +144,13 @@ static void page_free(T* ptr, size_t num) {
         THROW_ERRNO("page_free");
 }
 
-event_loop_t::event_loop_t(size_t max_fileno): max_fileno_(max_fileno) {
+event_loop_t::event_loop_t(size_t max_fileno): event_loop_t(max_fileno, nullptr) {}
+
+event_loop_t::event_loop_t(simulation& sim, size_t max_fileno): event_loop_t(max_fileno, &sim) {}
+
+event_loop_t::event_loop_t(size_t max_fileno, simulation* sim)
+    : selector_(sim ? selector(selector::no_init) : selector()), sim_(sim), max_fileno_(max_fileno)
+{
     if (max_fileno_ == 0)
         throw std::invalid_argument("max_fileno must be > 0");
     if (loop_ != nullptr)
@@ -75,11 +159,38 @@ event_loop_t::event_loop_t(size_t max_fileno): max_fileno_(max_fileno) {
 
     files_ = page_alloc<file_internal>(max_fileno_);
     constructed_files_ = page_alloc<size_t>(max_fileno_); // probably not necessary
+    loop_time_ = now();
+    events_.reserve(512);
+
+    // A simulated loop has no eventfd, run_once() picks its posts up.
+    if (sim_)
+        return;
+
+    remote_efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (remote_efd_ == -1)
+        THROW_ERRNO("event_loop_t: eventfd");
+    add_fd(remote_efd_, file_ops::readable, on_remote_wakeup, this);
 }
 
 event_loop_t::~event_loop_t() {
     TSL_ASSERT(loop_ == this);
 
+    // Components that own registered fds must go while files_ is alive.
+    io_pool_.reset();
+
+    // Hooks outliving the loop can still be stopped and destroyed.
+    for (auto& hooks : hooks_)
+        hooks.clear();
+
+    if (remote_efd_ != -1) {
+        del_fd(remote_efd_);
+        ::close(remote_efd_);
+    }
+    // Posted functions are freed; coroutines from resume_on() stay
+    // suspended, see resume_on().
+    while (auto node = remote_queue_.pop())
+        node->fn_(node, false);
+
     for (size_t i = 0; constructed_files_[i]; ++i) {
         size_t j = constructed_files_[i] - 1;
         files_[j].~file_internal();
@@ -89,123 +200,518 @@ event_loop_t::~event_loop_t() {
     loop_ = nullptr;
 }
 
-void event_loop_t::run() {
-    auto pending_events = [this]() -> bool {
-        return !scheduled_.empty() || selector_.get_num_events() > 0;
-    };
-
-    // Since we have to copy the handles from the queue, I am going to reuse the vector
-    // to avoid unnecessary allocations.
-    std::vector<std::coroutine_handle<>> awaiting;
-
-    std::vector<selector::event_data> events;
-    events.reserve(512);
-    while (pending_events()) {
-        events.clear();
-
-        if (scheduled_.empty()) {
-            selector_.wait(events);
-        } else {
-            auto timeout = scheduled_.top().time() - time_type::monotonic_clock();
-            if (timeout.as_ns() < 0)
-                timeout = {};
-
-            selector_.wait(events, timeout);
+void event_loop_t::post_node(remote_node* node) noexcept {
+    remote_queue_.push(node);
+
+    // Only the first post since the loop last drained the queue pays for
+    // the eventfd write.
+    if (!remote_wakeup_pending_.exchange(true, std::memory_order_seq_cst) && remote_efd_ != -1) {
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto r = ::write(remote_efd_, &one, sizeof(one));
+    }
+}
+
+void event_loop_t::on_remote_wakeup(void* ctx, selector::events) {
+    auto& loop = *static_cast<event_loop_t*>(ctx);
+
+    if (loop.remote_efd_ != -1) {
+        std::uint64_t value;
+        [[maybe_unused]] auto r = ::read(loop.remote_efd_, &value, sizeof(value));
+    }
+
+    // Cleared before draining, so a push the drain can't see yet (see
+    // mpsc_queue::pop) signals the eventfd again.
+    loop.remote_wakeup_pending_.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    while (auto node = loop.remote_queue_.pop())
+        node->fn_(node, true);
+}
+
+blocking_io_pool& event_loop_t::io_pool() {
+    if (!io_pool_)
+        io_pool_ = std::make_unique<blocking_io_pool>(*this);
+    return *io_pool_;
+}
+
+buffer_pool& event_loop_t::buffers() {
+    if (!buffers_)
+        buffers_ = std::make_unique<buffer_pool>();
+    return *buffers_;
+}
+
+time_type event_loop_t::now() const noexcept {
+    if (sim_) [[unlikely]]
+        return sim_->now();
+    return time_type::monotonic_clock();
+}
+
+void event_loop_t::select(std::vector<selector::event_data>& events, std::optional<time_type> timeout) {
+    if (sim_) [[unlikely]] {
+        // Pending posts stand for the eventfd wakeup: the clock must not
+        // jump past them.
+        if (remote_wakeup_pending_.load(std::memory_order_relaxed))
+            timeout = time_type {};
+        sim_->wait(events, timeout);
+    } else if (timeout)
+        selector_.wait(events, *timeout);
+    else
+        selector_.wait(events);
+}
+
+void event_loop_t::wait_events(std::vector<selector::event_data>& events, std::optional<time_type> timeout) {
+    flush_interest();
+
+    // Waiters the flush failed, or the last one did, must not wait for events.
+    for (auto& ready : ready_) {
+        if (!ready.empty())
+            timeout = time_type {};
+    }
+
+    if (busy_poll_.as_ns() > 0) [[unlikely]] {
+        auto start = now();
+        if (start - last_activity_ < busy_poll_) {
+            auto n = events.size();
+            select(events, time_type {});
+            busy_poll_stats_.spin_time += now() - start;
+            busy_poll_stats_.spins++;
+            if (events.size() > n)
+                busy_poll_stats_.hits++;
+            return;
         }
+    }
 
-        auto current_time = time_type::monotonic_clock();
-        while (!scheduled_.empty() && scheduled_.top().time() <= current_time) {
-            auto sc = scheduled_.top();
-            scheduled_.pop();
+    if (!scheduled_.empty()) {
+        auto until_deadline = scheduled_.top().deadline() - now();
+        if (!timeout || until_deadline < *timeout)
+            timeout = until_deadline;
+    }
+    // The selector takes negative timeouts as infinite.
+    if (timeout && timeout->as_ns() < 0)
+        timeout = time_type {};
 
-            sc.run();
+    select(events, timeout);
+}
+
+bool event_loop_t::alive() const noexcept {
+    return !scheduled_.empty() || num_fds_ > 0 || refs_ > 0;
+}
+
+void event_loop_t::run() {
+    stopped_ = false;
+    while (!stopped_ && alive())
+        run_once();
+}
+
+bool event_loop_t::run_for(time_type duration) {
+    stopped_ = false;
+    auto deadline = now() + duration;
+    while (!stopped_ && alive()) {
+        auto left = deadline - now();
+        if (left.as_ns() <= 0)
+            break;
+        run_once(left);
+    }
+    return alive();
+}
+
+std::optional<time_type> event_loop_t::next_deadline() const noexcept {
+    if (scheduled_.empty())
+        return std::nullopt;
+    return scheduled_.top().deadline();
+}
+
+void event_loop_t::stop() noexcept {
+    stopped_ = true;
+}
+
+bool event_loop_t::run_once(std::optional<time_type> timeout) {
+    // Nothing could ever wake it up.
+    if (!timeout && !alive())
+        return false;
+
+    run_hooks(loop_phase::idle);
+    if (!hooks_[static_cast<size_t>(loop_phase::idle)].empty())
+        timeout = time_type {};
+
+    // After the idle hooks, so it also flushes what they batched.
+    run_hooks(loop_phase::prepare);
+
+    auto& events = events_;
+    events.clear();
+
+    wait_events(events, timeout);
+
+    auto current_time = now();
+    loop_time_ = current_time;
+    if (!events.empty())
+        last_activity_ = current_time;
+
+    while (!scheduled_.empty() && scheduled_.top().time() <= current_time) {
+        auto sc = scheduled_.top();
+        scheduled_.pop();
+
+        last_activity_ = current_time;
+        ready_[static_cast<size_t>(sc.prio())].push_back(sc);
+    }
+
+    if (sim_ && remote_wakeup_pending_.load(std::memory_order_relaxed)) [[unlikely]] {
+        watchdog_scope scope { *this, reinterpret_cast<void*>(on_remote_wakeup) };
+        on_remote_wakeup(this, selector::events::input);
+    }
+
+    for (auto& ev : events) {
+        auto& file = files_[ev.fd];
+        // The fd was deleted (and maybe registered again) by a handler that
+        // ran earlier in this iteration, the event belongs to the old one.
+        if (!is_current(file, ev))
+            continue;
+
+        if (file.callback_) {
+            watchdog_scope scope { *this, reinterpret_cast<void*>(file.callback_) };
+            file.callback_(file.callback_ctx_, ev.flags);
+            continue;
         }
 
-        // TODO: A pending event from an old file descriptor may leak to the file descriptor
-        // if the file descriptor is removed and re-added while the events are being processed.
-        for (auto& ev : events) {
-            auto& file = files_[ev.fd];
-            // TODO: There is no need to check if the file is valid, since events may be pending the old
-            // file descriptor. this is temporary until I implement a way to notify events that the
-            // file descriptor was removed.
-
-            if (ev.flags & selector::events::input) {
-                awaiting.clear();
-                while (!file.reading_.empty()) {
-                    awaiting.push_back(file.reading_.front());
-                    file.reading_.pop();
-                }
-
-                for (auto coro : awaiting)
-                    coro.resume();
+        // Zerocopy completions raise EPOLLERR too, which the selector reports
+        // as every direction: reap them first, and go on with what is left.
+        if ((ev.flags & selector::events::error) && file.zc_done_ != file.zc_next_) [[unlikely]]
+            ev.flags = reap_zerocopy(file, current_time);
+
+        if (ev.flags & selector::events::input)
+            file.ready_ |= file_ops::readable;
+        if (ev.flags & selector::events::output)
+            file.ready_ |= file_ops::writable;
+
+        // The kernel disarmed the fd, waiters queued while dispatching re-arm it.
+        if (file.mode_ == trigger_mode::oneshot)
+            file.interest_ = file_ops::none;
+
+        auto wake = [&](std::queue<file_internal::waiter>& queue) {
+            while (!queue.empty()) {
+                auto& w = queue.front();
+                ready_[static_cast<size_t>(w.prio)].emplace_back(w.coro, current_time);
+                queue.pop();
             }
+        };
 
-            if (ev.flags & selector::events::output) {
-                awaiting.clear();
-                while (!file.writing_.empty()) {
-                    awaiting.push_back(file.writing_.front());
-                    file.writing_.pop();
-                }
+        if (ev.flags & selector::events::input)
+            wake(file.reading_);
+        if (ev.flags & selector::events::output)
+            wake(file.writing_);
+    }
 
-                for (auto coro : awaiting)
-                    coro.resume();
+    // Higher classes first, but everything that is ready now runs before
+    // the loop waits again, so lower classes can't starve.
+    for (auto& ready : ready_) {
+        // Handles leave the queue as they run, so if one throws out of
+        // run_once, the next call doesn't run the ones before it again.
+        std::size_t next = 0;
+        struct drop_ran {
+            std::vector<scheduled_handle>& ready;
+            std::size_t& next;
+
+            ~drop_ran() {
+                ready.erase(ready.begin(), ready.begin() + next);
             }
+        } guard { ready, next };
+
+        while (next < ready.size()) {
+            auto sc = ready[next++];
+            watchdog_scope scope { *this, sc.source() };
+            sc.run();
         }
     }
+
+    run_hooks(loop_phase::check);
+
+    // Only now, since the resumed coroutines may be waiting again.
+    for (auto& ev : events) {
+        auto& file = files_[ev.fd];
+        if (is_current(file, ev) && !file.callback_)
+            update_interest(file, ev.flags);
+    }
+
+    // So a host polling backend_fd() sees the interest left by this iteration.
+    flush_interest();
+    return alive();
 }
 
-void event_loop_t::add_fd(int fd, file_ops ops) {
-    ensure_fd_in_range(fd);
+void event_loop_t::run_hooks(loop_phase phase) {
+    auto& hooks = hooks_[static_cast<size_t>(phase)];
+    if (hooks.empty())
+        return;
 
-    if (files_[fd].is_valid())
-        throw std::invalid_argument(std::format("fd {} is already registered", fd));
+    // Each hook goes back to the list before it runs, so callbacks can stop
+    // any hook, and the ones they start wait for the next iteration.
+    internal::intrusive_list<hook> pending;
+    pending.splice(hooks);
+
+    // If a callback throws, the hooks it didn't get to stay active.
+    struct give_back {
+        internal::intrusive_list<hook>& hooks;
+        internal::intrusive_list<hook>& pending;
+
+        ~give_back() {
+            hooks.splice(pending);
+        }
+    } guard { hooks, pending };
+
+    while (auto h = pending.pop_front()) {
+        hooks.push_back(h);
+        watchdog_scope scope { *this, reinterpret_cast<void*>(h->callback_) };
+        h->callback_(h->ctx_);
+    }
+}
+
+INLINE bool event_loop_t::is_current(file_internal const& file, selector::event_data const& ev) noexcept {
+    return file.is_valid() && ev.tag == file.generation_;
+}
+
+std::error_code event_loop_t::register_fd(file_internal& file) {
+    TSL_ASSERT(!file.registered_);
+    if (sim_) [[unlikely]] {
+        sim_->add_fd(file.fd_, to_selector_events(file.interest_), file.mode_, file.generation_);
+    } else {
+        auto r = selector_.try_add_fd(file.fd_, to_selector_events(file.interest_), file.mode_,
+                                      file.generation_);
+        if (!r) [[unlikely]]
+            return r.error();
+    }
+    file.registered_ = true;
+    return {};
+}
+
+// Unregistered fds get their interest when registered, the others on the
+// next flush_interest(). Also re-arms a oneshot fd, even if unchanged.
+void event_loop_t::modify_interest(file_internal& file, file_ops interest) {
+    file.interest_ = interest;
+    if (file.registered_ && !file.dirty_) {
+        file.dirty_ = true;
+        dirty_.push_back(file.fd_);
+    }
+}
+
+void event_loop_t::flush_interest() {
+    for (int fd : dirty_) {
+        auto& file = files_[fd];
+        // Deleted (and maybe added again) since it was queued.
+        if (!file.dirty_)
+            continue;
+
+        file.dirty_ = false;
+        auto events = to_selector_events(file.interest_);
+        if (sim_) [[unlikely]] {
+            sim_->modify_fd(fd, events, file.mode_, file.generation_);
+            continue;
+        }
+
+        // ENOENT means the fd was closed without del_fd, and epoll dropped
+        // it. The number may already name an unrelated file, so it isn't
+        // added back: its waiters are failed instead.
+        auto r = selector_.try_modify_fd(fd, events, file.mode_, file.generation_);
+        if (!r) [[unlikely]]
+            fail_waiters(file, r.error());
+    }
+    dirty_.clear();
+}
+
+// The fd can't be waited on anymore, most likely closed without del_fd. Its
+// waiters are resumed to find out for themselves, those of a try_awaiter with
+// the error, and the next wait registers the fd again.
+void event_loop_t::fail_waiters(file_internal& file, std::error_code ec) {
+    file.registered_ = false;
+
+    for (auto* queue : { &file.reading_, &file.writing_ }) {
+        while (!queue->empty()) {
+            auto& w = queue->front();
+            if (w.ec)
+                *w.ec = ec;
+            ready_[static_cast<size_t>(w.prio)].emplace_back(w.coro, loop_time_);
+            queue->pop();
+        }
+    }
+    for (auto& w : file.zc_waiting_)
+        ready_[static_cast<size_t>(w.prio)].emplace_back(w.coro, loop_time_);
+    file.zc_waiting_.clear();
+}
+
+void event_loop_t::update_interest(file_internal& file, selector::events fired) {
+    file_ops waiting = file_ops::none;
+    if (!file.reading_.empty())
+        waiting |= file_ops::readable;
+    if (!file.writing_.empty())
+        waiting |= file_ops::writable;
+
+    file_ops interest = file.interest_;
+    if (file.mode_ == trigger_mode::oneshot) {
+        interest |= waiting;
+    } else {
+        // Lazily drop directions that woke us up with nobody waiting on them.
+        file_ops idle = to_file_ops(fired) & ~waiting;
+        interest &= ~idle;
+    }
+
+    if (interest != file.interest_)
+        modify_interest(file, interest);
+}
+
+result<> event_loop_t::try_add_fd(int fd, file_ops ops, trigger_mode mode) {
+    if (fd < 0 || static_cast<size_t>(fd) >= max_fileno_) [[unlikely]]
+        return std::unexpected(make_error_code(errc::fd_out_of_range));
+    if (files_[fd].is_valid()) [[unlikely]]
+        return std::unexpected(make_error_code(errc::fd_already_registered));
 
     if (!files_[fd].is_constructed())
         std::construct_at(&files_[fd], fd);
 
-    selector::events events = selector::events::none;
-    if (ops & file_ops::readable)
-        events |= selector::events::input;
-    if (ops & file_ops::writable)
-        events |= selector::events::output;
+    auto& file = files_[fd];
+    file.ops_ = ops;
+    file.ready_ = file_ops::none;
+    file.interest_ = mode == trigger_mode::edge ? ops : file_ops::none;
+    file.mode_ = mode;
+    file.valid_ = true;
+    file.registered_ = false;
+    file.dirty_ = false;
+    file.callback_ = nullptr;
+    file.callback_ctx_ = nullptr;
+    // Left over by a del_fd with waiters, recreating them would allocate.
+    if (!file.reading_.empty())
+        file.reading_ = {};
+    if (!file.writing_.empty())
+        file.writing_ = {};
+    file.zc_next_ = 0;
+    file.zc_done_ = 0;
+    file.zc_copied_ = false;
+    file.zc_waiting_.clear();
+    num_fds_++;
+    return {};
+}
+
+void event_loop_t::add_fd(int fd, file_ops ops, trigger_mode mode) {
+    if (auto r = try_add_fd(fd, ops, mode); !r)
+        throw_fd_error(r.error(), fd);
+}
 
-    selector_.add_fd(fd, events);
-    files_[fd].ops_ = ops;
-    files_[fd].valid_ = true;
-    files_[fd].reading_ = {};
-    files_[fd].writing_ = {};
+void event_loop_t::add_fd(int fd, file_ops ops, fd_callback_t callback, void* ctx) {
+    TSL_ASSERT(callback != nullptr);
+    add_fd(fd, ops);
+    // Nothing ever suspends on it, so it is registered right away.
+    if (auto ec = register_fd(files_[fd])) {
+        files_[fd].valid_ = false;
+        num_fds_--;
+        throw std::system_error(ec, "selector: add_fd: epoll_ctl");
+    }
+    files_[fd].callback_ = callback;
+    files_[fd].callback_ctx_ = ctx;
+    num_fds_--;
 }
 
 // TODO: If a file descriptor has events pending but is removed from the event loop,
 // it may cause the coroutine to hang indefinitely. We should probably wake up coroutines waiting
 // for I/O when the file descriptor is removed.
+result<> event_loop_t::try_del_fd(int fd) {
+    if (auto ec = check_fd(fd)) [[unlikely]]
+        return std::unexpected(ec);
+
+    auto& file = files_[fd];
+    if (file.registered_) {
+        if (sim_) [[unlikely]] {
+            sim_->del_fd(fd);
+        } else if (auto r = selector_.try_del_fd(fd); !r) [[unlikely]] {
+            return r;
+        }
+    }
+    file.registered_ = false;
+    file.dirty_ = false;
+    file.valid_ = false;
+    file.generation_++;
+    if (!file.callback_)
+        num_fds_--;
+    return {};
+}
+
 void event_loop_t::del_fd(int fd) {
-    ensure_fd_registered(fd);
+    if (auto r = try_del_fd(fd); !r)
+        throw_fd_error(r.error(), fd, "selector: del_fd: epoll_ctl");
+}
 
-    selector_.del_fd(fd);
-    files_[fd].valid_ = false;
+file_ops event_loop_t::readiness(int fd) const noexcept {
+    if (fd < 0 || static_cast<size_t>(fd) >= max_fileno_)
+        return file_ops::none;
+
+    auto& file = files_[fd];
+    if (!file.is_valid() || file.callback_)
+        return file_ops::none;
+    return file.ready_;
 }
 
-void event_loop_t::push_read_clb(int fd, std::coroutine_handle<> coro) {
+void event_loop_t::clear_ready(int fd, file_ops ops) {
     ensure_fd_registered(fd);
-    if (!(files_[fd].ops_ & file_ops::readable))
-        throw bad_file_descriptor(std::format("fd {} is not readable", fd));
-    files_[fd].reading_.push(coro);
+    files_[fd].ready_ &= ~ops;
 }
 
-void event_loop_t::push_write_clb(int fd, std::coroutine_handle<> coro) {
+void event_loop_t::set_interest(int fd, file_ops ops) {
     ensure_fd_registered(fd);
-    if (!(files_[fd].ops_ & file_ops::writable))
-        throw bad_file_descriptor(std::format("fd {} is not writable", fd));
-    files_[fd].writing_.push(coro);
+    modify_interest(files_[fd], ops & files_[fd].ops_);
+}
+
+std::error_code event_loop_t::push_clb(int fd, file_ops op, std::coroutine_handle<> coro, priority prio,
+                                       std::error_code* ec) {
+    if (auto ec = check_fd(fd)) [[unlikely]]
+        return ec;
+
+    auto& file = files_[fd];
+    if (!(file.ops_ & op)) [[unlikely]]
+        return op == file_ops::readable ? errc::fd_not_readable : errc::fd_not_writable;
+    if (file.callback_) [[unlikely]]
+        return errc::fd_dispatched_to_callback;
+
+    if (!(file.interest_ & op))
+        modify_interest(file, file.interest_ | op);
+    if (!file.registered_) {
+        if (auto ec = register_fd(file)) [[unlikely]]
+            return ec;
+    }
+
+    // Waiting means the caller saw EAGAIN, whatever edge came before.
+    file.ready_ &= ~op;
+
+    if (op == file_ops::readable)
+        file.reading_.push({ coro, prio, ec });
+    else
+        file.writing_.push({ coro, prio, ec });
+    return {};
+}
+
+void event_loop_t::push_read_clb(int fd, std::coroutine_handle<> coro, priority prio) {
+    if (auto ec = push_clb(fd, file_ops::readable, coro, prio))
+        throw_fd_error(ec, fd);
+}
+
+void event_loop_t::push_write_clb(int fd, std::coroutine_handle<> coro, priority prio) {
+    if (auto ec = push_clb(fd, file_ops::writable, coro, prio))
+        throw_fd_error(ec, fd);
 }
 
 void event_loop_t::read_awaiter::await_suspend(std::coroutine_handle<> coro) {
-    loop_.push_read_clb(fd_, coro);
+    loop_.push_read_clb(fd_, coro, prio_);
 }
 
 void event_loop_t::write_awaiter::await_suspend(std::coroutine_handle<> coro) {
-    loop_.push_write_clb(fd_, coro);
+    loop_.push_write_clb(fd_, coro, prio_);
+}
+
+void event_loop_t::ready_awaiter::await_suspend(std::coroutine_handle<> coro) {
+    if (op_ == file_ops::readable)
+        loop_.push_read_clb(fd_, coro, prio_);
+    else
+        loop_.push_write_clb(fd_, coro, prio_);
+}
+
+bool event_loop_t::try_awaiter::await_suspend(std::coroutine_handle<> coro) {
+    ec_ = loop_.push_clb(fd_, op_, coro, prio_, &ec_);
+    return !ec_;
 }
 
 }
@@ -0,0 +1,236 @@
+#include "rio/file_watcher.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+#include "rio/event_loop.hpp"
+#include "tsl/macros.hpp"
+
+using std::size_t;
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Events queued per watch while nobody waits, older ones are then replaced
+// by an IN_Q_OVERFLOW event, like the kernel does with its own queue.
+constexpr size_t MAX_QUEUED = 256;
+
+// Room for many events at once, and at least one with the longest name.
+constexpr size_t READ_BUFFER_SIZE = 16 * (sizeof(inotify_event) + NAME_MAX + 1);
+
+file_watcher::file_watcher(event_loop_t& loop)
+    : loop_(loop)
+{
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ == -1)
+        THROW_ERRNO("file_watcher: inotify_init1");
+
+    try {
+        loop_.add_fd(fd_, file_ops::readable, on_readable, this);
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+file_watcher::file_watcher()
+    : file_watcher(get_event_loop()) { }
+
+file_watcher::~file_watcher() {
+    if (alive_)
+        *alive_ = false;
+
+    for (auto& [wd, w] : watches_) {
+        for (size_t i = 0; i < w.waiters.size(); i++)
+            loop_.unref();
+    }
+
+    loop_.del_fd(fd_);
+    ::close(fd_);
+}
+
+int file_watcher::add_watch(const char* path, std::uint32_t mask) {
+    int wd = inotify_add_watch(fd_, path, mask);
+    if (wd == -1)
+        THROW_ERRNO("file_watcher: inotify_add_watch");
+
+    // The kernel may hand out the number of a watch that was removed.
+    auto& w = watches_[wd];
+    if (w.removed)
+        w = {};
+    return wd;
+}
+
+void file_watcher::remove_watch(int wd) {
+    auto it = watches_.find(wd);
+    if (it == watches_.end())
+        throw std::invalid_argument(std::format("file_watcher: unknown watch {}", wd));
+
+    if (!it->second.removed && inotify_rm_watch(fd_, wd) == -1 && errno != EINVAL)
+        THROW_ERRNO("file_watcher: inotify_rm_watch");
+
+    for (size_t i = 0; i < it->second.waiters.size(); i++)
+        loop_.unref();
+    watches_.erase(it);
+}
+
+file_watcher::watch& file_watcher::get_watch(int wd) {
+    auto it = watches_.find(wd);
+    if (it == watches_.end())
+        throw std::invalid_argument(std::format("file_watcher: unknown watch {}", wd));
+    return it->second;
+}
+
+bool file_watcher::awaiter::await_ready() const {
+    auto& w = watcher_.get_watch(wd_);
+    if (w.events.empty() && w.removed)
+        throw std::invalid_argument(std::format("file_watcher: watch {} was removed", wd_));
+    return !w.events.empty();
+}
+
+void file_watcher::awaiter::await_suspend(std::coroutine_handle<> coro) {
+    watcher_.get_watch(wd_).waiters.push_back(coro);
+    // A waiting coroutine keeps the loop running, unlike the inotify fd.
+    watcher_.loop_.ref();
+}
+
+watch_event file_watcher::awaiter::await_resume() {
+    auto& w = watcher_.get_watch(wd_);
+    TSL_ASSERT(!w.events.empty());
+
+    auto ev = std::move(w.events.front());
+    w.events.pop_front();
+    return ev;
+}
+
+// Points the watcher's alive_ at a flag for the duration of a dispatch and
+// detaches it on every way out, exceptions included. The destructor of the
+// watcher clears the flag, so the dispatch can tell it must stop.
+class file_watcher::alive_guard {
+public:
+    explicit alive_guard(file_watcher& watcher) noexcept
+        : watcher_(watcher), prev_(watcher.alive_)
+    {
+        // GCC can't tell that the destructor detaches the flag whenever the
+        // watcher is still there to point at it.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+        watcher_.alive_ = &alive_;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+    }
+
+    ~alive_guard() {
+        if (alive_)
+            watcher_.alive_ = prev_;
+        else if (prev_)
+            *prev_ = false;
+    }
+
+    alive_guard(alive_guard const&) = delete;
+    alive_guard& operator=(alive_guard const&) = delete;
+
+    bool alive() const noexcept {
+        return alive_;
+    }
+
+private:
+    file_watcher& watcher_;
+    bool* prev_;
+    bool alive_ = true;
+};
+
+// Returns with `alive_` false if a resumed coroutine destroyed the watcher.
+void file_watcher::dispatch(watch_event&& ev) {
+    int wd = ev.wd;
+    auto it = watches_.find(wd);
+    if (it == watches_.end())
+        return;
+
+    auto& w = it->second;
+    if (w.events.size() >= MAX_QUEUED) [[unlikely]] {
+        w.events.clear();
+        ev = { wd, IN_Q_OVERFLOW, 0, {} };
+    }
+    if (ev.mask & IN_IGNORED)
+        w.removed = true;
+    w.events.push_back(std::move(ev));
+
+    // Each event resumes one waiter, which takes it in await_resume. The
+    // watch is looked up again every time, the waiter may have removed it.
+    while (*alive_ && (it = watches_.find(wd)) != watches_.end()) {
+        auto& current = it->second;
+        if (current.events.empty() || current.waiters.empty())
+            break;
+
+        auto coro = current.waiters.front();
+        current.waiters.pop_front();
+        loop_.unref();
+        coro.resume();
+    }
+}
+
+void file_watcher::on_readable(void* ctx, selector::events) {
+    auto& watcher = *static_cast<file_watcher*>(ctx);
+    alignas(inotify_event) char buf[READ_BUFFER_SIZE];
+
+    alive_guard guard { watcher };
+
+    while (guard.alive()) {
+        ssize_t n = ::read(watcher.fd_, buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            THROW_ERRNO("file_watcher: read");
+        }
+
+        for (char* p = buf; guard.alive() && p < buf + n; ) {
+            inotify_event ie;
+            std::memcpy(&ie, p, sizeof(ie));
+            const char* name = p + sizeof(inotify_event);
+            p += sizeof(inotify_event) + ie.len;
+
+            // The kernel's queue overflowed: every watch may have lost events.
+            if (ie.wd == -1) {
+                std::vector<int> wds;
+                for (auto& [wd, w] : watcher.watches_)
+                    wds.push_back(wd);
+                for (size_t i = 0; guard.alive() && i < wds.size(); i++)
+                    watcher.dispatch({ wds[i], ie.mask, 0, {} });
+                continue;
+            }
+
+            watch_event ev { ie.wd, ie.mask, ie.cookie, {} };
+            if (ie.len > 0)
+                ev.name.assign(name, ::strnlen(name, ie.len));
+            watcher.dispatch(std::move(ev));
+        }
+    }
+}
+
+task<watch_event> watch(std::string path, std::uint32_t mask) {
+    file_watcher watcher;
+    int wd = watcher.add_watch(path.c_str(), mask);
+
+    for (;;) {
+        auto ev = co_await watcher.next(wd);
+        if (ev.mask & (mask | IN_IGNORED | IN_Q_OVERFLOW))
+            co_return ev;
+    }
+}
+
+}
@@ -0,0 +1,106 @@
+#include "rio/internal/find_byte.hpp"
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using std::size_t;
+
+namespace rio::internal {
+
+static const std::byte* find_byte_scalar(const std::byte* first, const std::byte* last,
+                                         std::byte value) noexcept {
+    for (; first != last; ++first) {
+        if (*first == value)
+            return first;
+    }
+    return last;
+}
+
+#if defined(__x86_64__)
+
+static const std::byte* find_byte_sse2(const std::byte* first, const std::byte* last,
+                                       std::byte value) noexcept {
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(value));
+    for (; last - first >= 16; first += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+    return find_byte_scalar(first, last, value);
+}
+
+__attribute__((target("avx2")))
+static const std::byte* find_byte_avx2(const std::byte* first, const std::byte* last,
+                                       std::byte value) noexcept {
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(value));
+    for (; last - first >= 32; first += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask)
+            return first + __builtin_ctz(mask);
+    }
+    return find_byte_sse2(first, last, value);
+}
+
+#elif defined(__aarch64__)
+
+static const std::byte* find_byte_neon(const std::byte* first, const std::byte* last,
+                                       std::byte value) noexcept {
+    const uint8x16_t needle = vdupq_n_u8(static_cast<std::uint8_t>(value));
+    for (; last - first >= 16; first += 16) {
+        uint8x16_t chunk = vld1q_u8(reinterpret_cast<const std::uint8_t*>(first));
+        uint8x16_t eq = vceqq_u8(chunk, needle);
+        // Narrow every byte of the comparison to a nibble of a 64-bit mask.
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (mask)
+            return first + (__builtin_ctzll(mask) >> 2);
+    }
+    return find_byte_scalar(first, last, value);
+}
+
+#endif
+
+using find_byte_fn = const std::byte* (*)(const std::byte*, const std::byte*, std::byte) noexcept;
+
+struct find_byte_impl_t {
+    find_byte_fn fn;
+    const char* name;
+};
+
+static find_byte_impl_t select_find_byte() noexcept {
+#if defined(__x86_64__)
+    // libgcc fills in the CPU model from a constructor, which may not have
+    // run yet when this is called during static initialization.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { find_byte_avx2, "avx2" };
+    return { find_byte_sse2, "sse2" };
+#elif defined(__aarch64__)
+    return { find_byte_neon, "neon" };
+#else
+    return { find_byte_scalar, "scalar" };
+#endif
+}
+
+// A function-local static, so it is safe to use during static initialization.
+static find_byte_impl_t const& get_impl() noexcept {
+    static const find_byte_impl_t impl = select_find_byte();
+    return impl;
+}
+
+const std::byte* find_byte(const std::byte* first, const std::byte* last, std::byte value) noexcept {
+    return get_impl().fn(first, last, value);
+}
+
+const char* find_byte_impl() noexcept {
+    return get_impl().name;
+}
+
+}
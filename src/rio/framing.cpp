@@ -0,0 +1,91 @@
+#include "rio/framing.hpp"
+
+#include <format>
+#include <stdexcept>
+#include "rio/internal/find_byte.hpp"
+
+using std::size_t;
+
+namespace rio {
+
+[[noreturn]] static void throw_frame_too_large(const char* decoder, size_t max_size) {
+    throw std::length_error(std::format("{}: frame exceeds {} bytes", decoder, max_size));
+}
+
+std::optional<frame> delimiter_decoder::decode(std::span<const std::byte> buf) {
+    const std::byte* first = buf.data() + scanned_;
+    const std::byte* last = buf.data() + buf.size();
+    const std::byte* pos = internal::find_byte(first, last, delimiter_);
+
+    if (pos == last) {
+        scanned_ = buf.size();
+        if (scanned_ > max_size_) [[unlikely]]
+            throw_frame_too_large("delimiter_decoder", max_size_);
+        return std::nullopt;
+    }
+
+    size_t size = pos - buf.data();
+    if (size > max_size_) [[unlikely]]
+        throw_frame_too_large("delimiter_decoder", max_size_);
+
+    scanned_ = 0;
+    return frame { buf.first(size), size + 1 };
+}
+
+std::optional<frame> line_decoder::decode(std::span<const std::byte> buf) {
+    auto f = delimiter_.decode(buf);
+    if (f && !f->data.empty() && f->data.back() == std::byte { '\r' })
+        f->data = f->data.first(f->data.size() - 1);
+    return f;
+}
+
+length_prefixed_decoder::length_prefixed_decoder(size_t header_size, size_t max_size)
+    : header_size_(header_size), max_size_(max_size)
+{
+    if (header_size_ != 1 && header_size_ != 2 && header_size_ != 4 && header_size_ != 8)
+        throw std::invalid_argument("length_prefixed_decoder: header_size must be 1, 2, 4 or 8");
+}
+
+std::optional<frame> length_prefixed_decoder::decode(std::span<const std::byte> buf) {
+    if (buf.size() < header_size_)
+        return std::nullopt;
+
+    std::uint64_t size = 0;
+    for (size_t i = 0; i < header_size_; i++)
+        size = (size << 8) | std::to_integer<std::uint64_t>(buf[i]);
+
+    if (size > max_size_) [[unlikely]]
+        throw_frame_too_large("length_prefixed_decoder", max_size_);
+    if (buf.size() - header_size_ < size)
+        return std::nullopt;
+
+    return frame { buf.subspan(header_size_, size), header_size_ + size };
+}
+
+std::optional<frame> http_header_decoder::decode(std::span<const std::byte> buf) {
+    const std::byte* data = buf.data();
+    const std::byte* last = data + buf.size();
+    const std::byte* pos = data + scanned_;
+
+    // Every line ends with "\n", so only those need a closer look.
+    while ((pos = internal::find_byte(pos, last, std::byte { '\n' })) != last) {
+        size_t i = pos - data;
+        bool empty_line = (i >= 1 && data[i - 1] == std::byte { '\n' })
+                       || (i >= 2 && data[i - 1] == std::byte { '\r' } && data[i - 2] == std::byte { '\n' });
+        if (empty_line) {
+            if (i + 1 > max_size_) [[unlikely]]
+                throw_frame_too_large("http_header_decoder", max_size_);
+
+            scanned_ = 0;
+            return frame { buf.first(i + 1), i + 1 };
+        }
+        ++pos;
+    }
+
+    scanned_ = buf.size();
+    if (scanned_ > max_size_) [[unlikely]]
+        throw_frame_too_large("http_header_decoder", max_size_);
+    return std::nullopt;
+}
+
+}
@@ -0,0 +1,330 @@
+#include "rio/prefork.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <exception>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <optional>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include "rio/event_loop.hpp"
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Sent over the control socket to ask a worker to drain.
+static constexpr char DRAIN_COMMAND = 'd';
+
+task<> prefork_worker::drain_requested() {
+    auto& loop = get_event_loop();
+    loop.add_fd(control_, file_ops::readable);
+
+    for (;;) {
+        // Either the drain command, or end of file if the supervisor died.
+        char command;
+        if (::read(control_, &command, 1) >= 0)
+            break;
+
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            THROW_ERRNO("prefork_worker: read");
+
+        co_await loop.await_read(control_);
+    }
+
+    loop.del_fd(control_);
+}
+
+prefork_supervisor::prefork_supervisor(worker_main_t worker_main, prefork_options options)
+    : worker_main_(std::move(worker_main)), options_(options)
+{
+    if (!worker_main_)
+        throw std::invalid_argument("prefork_supervisor: worker_main is empty");
+
+    auto workers = options_.workers;
+    if (workers == 0) {
+        long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? static_cast<std::size_t>(cpus) : 1;
+    }
+    slots_.resize(workers);
+}
+
+prefork_supervisor::~prefork_supervisor() {
+    for (auto& fds : listeners_)
+        for (int fd : fds)
+            ::close(fd);
+    for (auto& s : slots_)
+        if (s.control != -1)
+            ::close(s.control);
+}
+
+std::size_t prefork_supervisor::add_listener(sockaddr const* addr, socklen_t addr_len, int backlog) {
+    std::size_t count = options_.mode == listener_mode::reuseport ? slots_.size() : 1;
+    std::vector<int> fds;
+
+    auto fail = [&](const char* what) {
+        int saved = errno;
+        for (int fd : fds)
+            ::close(fd);
+        errno = saved;
+        THROW_ERRNO(what);
+    };
+
+    // Every socket but the first binds to the address the first one got, so
+    // they share the port even when `addr` asks for any port.
+    sockaddr_storage bound;
+    socklen_t bound_len = addr_len;
+
+    for (std::size_t i = 0; i < count; i++) {
+        int fd = ::socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            fail("prefork_supervisor: socket");
+        fds.push_back(fd);
+
+        int one = 1;
+        if (addr->sa_family != AF_UNIX &&
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1)
+            fail("prefork_supervisor: setsockopt(SO_REUSEADDR)");
+        if (options_.mode == listener_mode::reuseport &&
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
+            fail("prefork_supervisor: setsockopt(SO_REUSEPORT)");
+
+        auto target = i == 0 ? addr : reinterpret_cast<sockaddr const*>(&bound);
+        if (::bind(fd, target, i == 0 ? addr_len : bound_len) == -1)
+            fail("prefork_supervisor: bind");
+        if (::listen(fd, backlog) == -1)
+            fail("prefork_supervisor: listen");
+
+        if (i == 0) {
+            bound_len = sizeof(bound);
+            if (::getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &bound_len) == -1)
+                fail("prefork_supervisor: getsockname");
+        }
+    }
+
+    listeners_.push_back(std::move(fds));
+    return listeners_.size() - 1;
+}
+
+std::uint16_t prefork_supervisor::port(std::size_t i) const {
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (::getsockname(listeners_.at(i).front(), reinterpret_cast<sockaddr*>(&addr), &len) == -1)
+        THROW_ERRNO("prefork_supervisor: getsockname");
+
+    if (addr.ss_family == AF_INET)
+        return ntohs(reinterpret_cast<sockaddr_in const&>(addr).sin_port);
+    if (addr.ss_family == AF_INET6)
+        return ntohs(reinterpret_cast<sockaddr_in6 const&>(addr).sin6_port);
+    return 0;
+}
+
+void prefork_supervisor::run() {
+    // Forked workers would share the loop's epoll instance and fds.
+    if (event_loop_t::exists())
+        throw std::logic_error("prefork_supervisor: run() called with an event loop in the process");
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    if (int r = ::pthread_sigmask(SIG_BLOCK, &signals, &old_mask_); r != 0)
+        throw std::system_error(r, std::system_category(), "prefork_supervisor: pthread_sigmask");
+
+    try {
+        for (std::size_t i = 0; i < slots_.size(); i++)
+            start_worker(i);
+
+        bool draining = false;
+        std::optional<time_type> drain_deadline;
+
+        for (;;) {
+            // Wake up for the earliest restart, or the end of the drain.
+            std::optional<time_type> wake = drain_deadline;
+            if (!draining) {
+                for (auto& s : slots_)
+                    if (s.pid == -1 && (!wake || s.restart_at < *wake))
+                        wake = s.restart_at;
+            }
+
+            int signo;
+            if (wake) {
+                auto left = *wake - time_type::monotonic_clock();
+                if (left.as_ns() < 0)
+                    left = time_type {};
+                auto ts = left.as_timespec();
+                signo = ::sigtimedwait(&signals, nullptr, &ts);
+            } else {
+                signo = ::sigwaitinfo(&signals, nullptr);
+            }
+            if (signo == -1 && errno != EAGAIN && errno != EINTR)
+                THROW_ERRNO("prefork_supervisor: sigtimedwait");
+
+            if (signo == SIGCHLD) {
+                reap(draining);
+            } else if (signo == SIGTERM || signo == SIGINT) {
+                if (!draining) {
+                    draining = true;
+                    drain_deadline = time_type::monotonic_clock() + options_.drain_timeout;
+                    drain();
+                } else {
+                    // Asked twice, don't wait for the drain.
+                    drain_deadline.reset();
+                    kill_all();
+                }
+            }
+
+            auto now = time_type::monotonic_clock();
+            if (draining) {
+                bool any_running = false;
+                for (auto& s : slots_)
+                    any_running |= s.pid != -1;
+                if (!any_running)
+                    break;
+
+                if (drain_deadline && now >= *drain_deadline) {
+                    drain_deadline.reset();
+                    kill_all();
+                }
+                continue;
+            }
+
+            for (std::size_t i = 0; i < slots_.size(); i++) {
+                if (slots_[i].pid == -1 && slots_[i].restart_at <= now) {
+                    start_worker(i);
+                    restarts_++;
+                }
+            }
+        }
+    } catch (...) {
+        kill_all();
+        for (auto& s : slots_) {
+            if (s.pid != -1)
+                ::waitpid(s.pid, nullptr, 0);
+            s.pid = -1;
+        }
+        ::pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+        throw;
+    }
+
+    ::pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+}
+
+void prefork_supervisor::start_worker(std::size_t index) {
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+        THROW_ERRNO("prefork_supervisor: socketpair");
+
+    // Or buffered output would be written by both processes.
+    std::fflush(nullptr);
+
+    pid_t pid = ::fork();
+    if (pid == -1) {
+        int saved = errno;
+        ::close(sv[0]);
+        ::close(sv[1]);
+        errno = saved;
+        THROW_ERRNO("prefork_supervisor: fork");
+    }
+
+    if (pid == 0) {
+        ::close(sv[0]);
+        run_worker(index, sv[1]);
+    }
+
+    ::close(sv[1]);
+    slots_[index].pid = pid;
+    slots_[index].control = sv[0];
+}
+
+void prefork_supervisor::run_worker(std::size_t index, int control) {
+    // SIGINT and SIGTERM sent to the whole process group, like a ^C in the
+    // terminal, are the supervisor's to handle: it drains the workers. The
+    // worker still shares the group, so it keeps its controlling terminal.
+    ::signal(SIGINT, SIG_IGN);
+    ::signal(SIGTERM, SIG_IGN);
+    ::pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+
+    // Keep only this worker's ends of the control sockets and listeners.
+    for (auto& s : slots_)
+        if (s.control != -1)
+            ::close(s.control);
+
+    std::vector<int> listeners;
+    for (auto& fds : listeners_) {
+        std::size_t mine = options_.mode == listener_mode::reuseport ? index : 0;
+        for (std::size_t i = 0; i < fds.size(); i++) {
+            if (i == mine)
+                listeners.push_back(fds[i]);
+            else
+                ::close(fds[i]);
+        }
+    }
+
+    ::fcntl(control, F_SETFL, ::fcntl(control, F_GETFL) | O_NONBLOCK);
+
+    prefork_worker worker { index, std::move(listeners), control };
+    int status;
+    try {
+        status = worker_main_(worker);
+    } catch (...) {
+        // Unwinding would go back into the supervisor's code.
+        std::terminate();
+    }
+
+    // exit() would also run the atexit handlers and static destructors of
+    // the supervisor's state the worker inherited.
+    std::fflush(nullptr);
+    ::_exit(status);
+}
+
+// Waits for the workers only, not for other children of the process.
+void prefork_supervisor::reap(bool draining) {
+    for (std::size_t i = 0; i < slots_.size(); i++) {
+        auto& s = slots_[i];
+        if (s.pid == -1)
+            continue;
+
+        int status;
+        pid_t pid;
+        while ((pid = ::waitpid(s.pid, &status, WNOHANG)) == -1 && errno == EINTR) { }
+        if (pid <= 0)
+            continue;
+
+        s.pid = -1;
+        ::close(s.control);
+        s.control = -1;
+        if (!draining)
+            s.restart_at = time_type::monotonic_clock() + options_.restart_delay;
+
+        if (exit_handler_)
+            exit_handler_(exit_ctx_, i, pid, status);
+    }
+}
+
+void prefork_supervisor::drain() {
+    for (auto& s : slots_) {
+        // A worker that already exited is reaped with the next SIGCHLD.
+        if (s.pid != -1)
+            ::send(s.control, &DRAIN_COMMAND, 1, MSG_NOSIGNAL);
+    }
+}
+
+void prefork_supervisor::kill_all() noexcept {
+    for (auto& s : slots_)
+        if (s.pid != -1)
+            ::kill(s.pid, SIGKILL);
+}
+
+}
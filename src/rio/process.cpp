@@ -0,0 +1,344 @@
+#include "rio/process.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include "rio/event_loop.hpp"
+
+extern char** environ;
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+static int pidfd_open(pid_t pid) {
+    return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+}
+
+static int pidfd_send_signal(int pidfd, int signo) {
+    return static_cast<int>(::syscall(SYS_pidfd_send_signal, pidfd, signo, nullptr, 0));
+}
+
+// P_PIDFD, missing from the idtype_t of older glibc headers.
+static constexpr auto IDTYPE_PIDFD = static_cast<idtype_t>(3);
+
+// Reaps the child behind `pidfd`, and only that one, storing a waitpid(2)
+// style status. Returns 1 if it was reaped, 0 if it is still running (with
+// WNOHANG in `options`) and -1 on error.
+static int reap_pidfd(int pidfd, int options, int& status) {
+    siginfo_t info {};
+    while (::waitid(IDTYPE_PIDFD, static_cast<id_t>(pidfd), &info, WEXITED | options) == -1) {
+        if (errno != EINTR)
+            return -1;
+    }
+    if (info.si_pid == 0)
+        return 0;
+
+    switch (info.si_code) {
+    case CLD_EXITED:
+        status = W_EXITCODE(info.si_status, 0);
+        break;
+    case CLD_DUMPED:
+        status = W_EXITCODE(0, info.si_status) | WCOREFLAG;
+        break;
+    default:
+        status = W_EXITCODE(0, info.si_status);
+        break;
+    }
+    return 1;
+}
+
+process::~process() {
+    reset();
+}
+
+process::process(process&& other) noexcept
+    : pid_(std::exchange(other.pid_, -1)),
+      pidfd_(std::exchange(other.pidfd_, -1)),
+      stdin_(std::exchange(other.stdin_, -1)),
+      stdout_(std::exchange(other.stdout_, -1)),
+      stderr_(std::exchange(other.stderr_, -1)),
+      status_(other.status_),
+      exited_(other.exited_) { }
+
+process& process::operator=(process&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pid_ = std::exchange(other.pid_, -1);
+        pidfd_ = std::exchange(other.pidfd_, -1);
+        stdin_ = std::exchange(other.stdin_, -1);
+        stdout_ = std::exchange(other.stdout_, -1);
+        stderr_ = std::exchange(other.stderr_, -1);
+        status_ = other.status_;
+        exited_ = other.exited_;
+    }
+    return *this;
+}
+
+void process::close_fd(int& fd) noexcept {
+    if (fd == -1)
+        return;
+
+    if (auto loop = event_loop_t::get_or_null()) {
+        try {
+            loop->del_fd(fd);
+        } catch (...) {
+            // Already removed, closing it is all that's left to do.
+        }
+    }
+    ::close(fd);
+    fd = -1;
+}
+
+// Reaps a killed child once its pidfd turns readable, then closes the pidfd.
+static void reap_killed(void* ctx, selector::events) {
+    int pidfd = static_cast<int>(reinterpret_cast<std::intptr_t>(ctx));
+    int status;
+    if (reap_pidfd(pidfd, WNOHANG, status) == 0)
+        return;
+
+    get_event_loop().del_fd(pidfd);
+    ::close(pidfd);
+}
+
+// A child that is still running when its process object goes away is
+// killed, and reaped like one that already exited, so none is left behind
+// as a zombie. The loop reaps it once it is gone, the destructor never
+// waits for it; without a loop there is nothing else to do but wait.
+void process::reset() noexcept {
+    close_fd(stdin_);
+    close_fd(stdout_);
+    close_fd(stderr_);
+
+    if (pidfd_ != -1 && !exited_) {
+        int status;
+        if (reap_pidfd(pidfd_, WNOHANG, status) == 0) {
+            pidfd_send_signal(pidfd_, SIGKILL);
+            if (hand_to_loop(pidfd_))
+                pidfd_ = -1;
+            else
+                reap_pidfd(pidfd_, 0, status);
+        }
+    }
+    close_fd(pidfd_);
+    pid_ = -1;
+}
+
+bool process::hand_to_loop(int pidfd) noexcept {
+    auto loop = event_loop_t::get_or_null();
+    if (!loop)
+        return false;
+
+    try {
+        loop->del_fd(pidfd);
+    } catch (...) {
+        // Not registered, add_fd below does it.
+    }
+    try {
+        // Readiness is checked when the fd is added, so a child that
+        // already died is reaped on the next iteration.
+        loop->add_fd(pidfd, file_ops::readable, reap_killed,
+                     reinterpret_cast<void*>(static_cast<std::intptr_t>(pidfd)));
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+void process::close_stdin() noexcept {
+    close_fd(stdin_);
+}
+
+void process::kill(int signo) {
+    if (pidfd_ == -1 || exited_)
+        return;
+    if (pidfd_send_signal(pidfd_, signo) == -1)
+        THROW_ERRNO("process: kill: pidfd_send_signal");
+}
+
+task<int> process::wait() {
+    auto& loop = get_event_loop();
+
+    // Moved from or reset: there is no child, and waiting on pid -1 would
+    // reap any child of the process.
+    if (pidfd_ == -1 && !exited_)
+        throw std::logic_error("process: wait: no child process");
+
+    while (!exited_) {
+        int status;
+        int r = reap_pidfd(pidfd_, WNOHANG, status);
+        if (r == -1)
+            THROW_ERRNO("process: wait: waitid");
+
+        if (r == 0) {
+            co_await loop.await_read(pidfd_);
+            continue;
+        }
+
+        status_ = status;
+        exited_ = true;
+        close_fd(pidfd_);
+    }
+
+    co_return status_;
+}
+
+namespace {
+
+// Owns the temporary state of a spawn, closing whatever is left on failure.
+struct spawn_state {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int child_fds[3] = { -1, -1, -1 };
+    int parent_fds[3] = { -1, -1, -1 };
+
+    spawn_state() {
+        if (int err = posix_spawn_file_actions_init(&actions)) {
+            errno = err;
+            THROW_ERRNO("spawn: posix_spawn_file_actions_init");
+        }
+        if (int err = posix_spawnattr_init(&attr)) {
+            posix_spawn_file_actions_destroy(&actions);
+            errno = err;
+            THROW_ERRNO("spawn: posix_spawnattr_init");
+        }
+
+        // The loop thread blocks the signals it watches, and a prefork worker
+        // ignores SIGINT and SIGTERM: the child gets neither, so it can be
+        // stopped like any other program.
+        sigset_t empty, all;
+        sigemptyset(&empty);
+        sigfillset(&all);
+        int err = posix_spawnattr_setsigmask(&attr, &empty);
+        if (!err)
+            err = posix_spawnattr_setsigdefault(&attr, &all);
+        if (!err)
+            err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+        if (err) {
+            posix_spawnattr_destroy(&attr);
+            posix_spawn_file_actions_destroy(&actions);
+            errno = err;
+            THROW_ERRNO("spawn: posix_spawnattr");
+        }
+    }
+
+    ~spawn_state() {
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        for (int i = 0; i < 3; i++) {
+            if (child_fds[i] != -1)
+                ::close(child_fds[i]);
+            if (parent_fds[i] != -1)
+                ::close(parent_fds[i]);
+        }
+    }
+
+    void setup(int target, stdio_mode mode) {
+        int err = 0;
+        switch (mode) {
+        case stdio_mode::inherit:
+            return;
+        case stdio_mode::null:
+            err = posix_spawn_file_actions_addopen(&actions, target, "/dev/null",
+                                                   target == 0 ? O_RDONLY : O_WRONLY, 0);
+            break;
+        case stdio_mode::pipe: {
+            int fds[2];
+            if (::pipe2(fds, O_CLOEXEC) == -1)
+                THROW_ERRNO("spawn: pipe2");
+
+            // stdin is read by the child, stdout and stderr are written.
+            int child = target == 0 ? fds[0] : fds[1];
+            int parent = target == 0 ? fds[1] : fds[0];
+            child_fds[target] = child;
+            parent_fds[target] = parent;
+
+            // Only the parent end is non-blocking, the child gets a normal pipe.
+            int flags = ::fcntl(parent, F_GETFL);
+            if (flags == -1 || ::fcntl(parent, F_SETFL, flags | O_NONBLOCK) == -1)
+                THROW_ERRNO("spawn: fcntl");
+
+            err = posix_spawn_file_actions_adddup2(&actions, child, target);
+            break;
+        }
+        }
+
+        if (err) {
+            errno = err;
+            THROW_ERRNO("spawn: posix_spawn_file_actions");
+        }
+    }
+};
+
+std::vector<char*> make_argv(std::vector<std::string>& strings) {
+    std::vector<char*> argv;
+    argv.reserve(strings.size() + 1);
+    for (auto& s : strings)
+        argv.push_back(s.data());
+    argv.push_back(nullptr);
+    return argv;
+}
+
+}
+
+task<process> spawn(spawn_options options) {
+    auto& loop = get_event_loop();
+
+    if (options.args.empty())
+        options.args.push_back(options.file);
+
+    spawn_state state;
+    state.setup(0, options.stdin_mode);
+    state.setup(1, options.stdout_mode);
+    state.setup(2, options.stderr_mode);
+
+    auto argv = make_argv(options.args);
+    auto envp = make_argv(options.env);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, options.file.c_str(), &state.actions, &state.attr,
+                           argv.data(), options.env.empty() ? environ : envp.data());
+    if (err) {
+        errno = err;
+        THROW_ERRNO("spawn: posix_spawnp");
+    }
+
+    // From here on the child is running: if setting up its process object
+    // fails, reset() kills and reaps it, and without a pidfd it's done here.
+    process proc;
+    proc.pid_ = pid;
+
+    proc.pidfd_ = pidfd_open(pid);
+    if (proc.pidfd_ == -1) {
+        int saved = errno;
+        ::kill(pid, SIGKILL);
+        while (::waitpid(pid, nullptr, 0) == -1 && errno == EINTR) { }
+        errno = saved;
+        THROW_ERRNO("spawn: pidfd_open");
+    }
+    loop.add_fd(proc.pidfd_, file_ops::readable);
+
+    int* targets[3] = { &proc.stdin_, &proc.stdout_, &proc.stderr_ };
+    for (int i = 0; i < 3; i++) {
+        if (state.parent_fds[i] == -1)
+            continue;
+
+        *targets[i] = std::exchange(state.parent_fds[i], -1);
+        loop.add_fd(*targets[i], i == 0 ? file_ops::writable : file_ops::readable);
+    }
+
+    co_return proc;
+}
+
+}
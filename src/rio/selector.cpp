@@ -4,12 +4,24 @@
 #include <cstddef>
 #include <memory>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <system_error>
 #include <unistd.h>
 #include "tsl/macros.hpp"
 
 using std::size_t;
 
+// Older libc headers don't know about the epoll busy-poll ioctls.
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
 // Maximum events per wait call, hard-limit so it can be stack allocated.
 constexpr size_t MAX_EVENTS = 1024;
 
@@ -20,6 +32,10 @@ constexpr size_t MAX_EVENTS = 1024;
 }
 #define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
 
+[[noreturn]] static void throw_error(std::error_code ec, const char* what) {
+    throw std::system_error(ec, what);
+}
+
 namespace rio {
 
 const char* bad_selector_access::what() const noexcept {
@@ -55,36 +71,79 @@ selector& selector::operator=(selector&& other) noexcept {
     return *this;
 }
 
-void selector::add_fd(int fd, events ev) {
+void selector::set_busy_poll(std::uint32_t usecs, std::uint16_t budget, bool prefer) {
     THROW_IF_UNITIALIZED();
 
+    epoll_params params {};
+    params.busy_poll_usecs = usecs;
+    params.busy_poll_budget = budget;
+    params.prefer_busy_poll = prefer;
+
+    if (ioctl(epfd_, EPIOCSPARAMS, &params) == -1)
+        THROW_ERRNO("selector: set_busy_poll: ioctl(EPIOCSPARAMS)");
+}
+
+static epoll_event make_epoll_event(int fd, selector::events ev, trigger_mode mode,
+                                    std::uint32_t tag) noexcept {
     struct epoll_event epev;
-    epev.events = EPOLLET;
-    if (ev & events::input)
+    switch (mode) {
+    case trigger_mode::edge:
+        epev.events = EPOLLET;
+        break;
+    case trigger_mode::level:
+        epev.events = 0;
+        break;
+    case trigger_mode::oneshot:
+        epev.events = EPOLLONESHOT;
+        break;
+    }
+
+    if (ev & selector::events::input)
         epev.events |= (EPOLLIN | EPOLLPRI | EPOLLRDHUP);
-    if (ev & events::output)
+    if (ev & selector::events::output)
         epev.events |= EPOLLOUT;
-    epev.data.fd = fd;
+    epev.data.u64 = (static_cast<std::uint64_t>(tag) << 32) | static_cast<std::uint32_t>(fd);
+    return epev;
+}
 
+static std::unexpected<std::error_code> errno_error() noexcept {
+    return std::unexpected(std::error_code(errno, std::system_category()));
+}
+
+result<> selector::try_add_fd(int fd, events ev, trigger_mode mode, std::uint32_t tag) {
+    THROW_IF_UNITIALIZED();
+
+    auto epev = make_epoll_event(fd, ev, mode, tag);
     if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &epev) == -1)
-        THROW_ERRNO("selector: add_fd: epoll_ctl");
+        return errno_error();
     num_events_++;
-} 
+    return {};
+}
 
-void selector::del_fd(int fd) {
+result<> selector::try_modify_fd(int fd, events ev, trigger_mode mode, std::uint32_t tag) {
+    THROW_IF_UNITIALIZED();
+
+    auto epev = make_epoll_event(fd, ev, mode, tag);
+    if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &epev) == -1)
+        return errno_error();
+    return {};
+}
+
+result<> selector::try_del_fd(int fd) {
     THROW_IF_UNITIALIZED();
 
     if (epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr) == -1)
-        THROW_ERRNO("selector: del_fd: epoll_ctl");
+        return errno_error();
     TSL_ASSERT(num_events_ > 0);
     num_events_--;
+    return {};
 }
 
-int selector::wait(std::vector<event_data>& data) {
+result<int> selector::try_wait(std::vector<event_data>& data) {
     return _wait(data, nullptr);
 }
 
-int selector::wait(std::vector<event_data>& data, time_type timeout) {
+result<int> selector::try_wait(std::vector<event_data>& data, time_type timeout) {
     if (timeout.as_ns() < 0)
         return _wait(data, nullptr);
 
@@ -92,7 +151,36 @@ int selector::wait(std::vector<event_data>& data, time_type timeout) {
     return _wait(data, &ts);
 }
 
-int selector::_wait(std::vector<event_data>& data, std::timespec* timeout) {
+void selector::add_fd(int fd, events ev, trigger_mode mode, std::uint32_t tag) {
+    if (auto r = try_add_fd(fd, ev, mode, tag); !r)
+        throw_error(r.error(), "selector: add_fd: epoll_ctl");
+}
+
+void selector::modify_fd(int fd, events ev, trigger_mode mode, std::uint32_t tag) {
+    if (auto r = try_modify_fd(fd, ev, mode, tag); !r)
+        throw_error(r.error(), "selector: modify_fd: epoll_ctl");
+}
+
+void selector::del_fd(int fd) {
+    if (auto r = try_del_fd(fd); !r)
+        throw_error(r.error(), "selector: del_fd: epoll_ctl");
+}
+
+int selector::wait(std::vector<event_data>& data) {
+    auto r = try_wait(data);
+    if (!r)
+        throw_error(r.error(), "selector: wait: epoll_pwait2");
+    return *r;
+}
+
+int selector::wait(std::vector<event_data>& data, time_type timeout) {
+    auto r = try_wait(data, timeout);
+    if (!r)
+        throw_error(r.error(), "selector: wait: epoll_pwait2");
+    return *r;
+}
+
+result<int> selector::_wait(std::vector<event_data>& data, std::timespec* timeout) {
     THROW_IF_UNITIALIZED();
 
     // maybe check if num_events_ is 0? small optimization, but probably useless.
@@ -102,24 +190,28 @@ int selector::_wait(std::vector<event_data>& data, std::timespec* timeout) {
     if (n == -1) {
         if (errno == EINTR) 
             return 0;
-        THROW_ERRNO("selector: wait: epoll_pwait2");
+        return errno_error();
     }
 
     // I hope EOF sends EPOLLIN or EPOLLPRI :)
     for (int i = 0; i < n; i++) {
         uint32_t mask = events[i].events;
+        std::uint64_t tagged = events[i].data.u64;
 
         event_data ev {
-            .fd = events[i].data.fd,
-            .flags = events::none
+            .fd = static_cast<int>(tagged & 0xffffffff),
+            .flags = events::none,
+            .tag = static_cast<std::uint32_t>(tagged >> 32)
         };
 
         if (mask & EPOLLERR) {
-            ev.flags = selector::events::input | selector::events::output;
+            ev.flags = selector::events::input | selector::events::output | selector::events::error;
         } else {
-            if (mask & (EPOLLIN | EPOLLPRI | EPOLLRDHUP))
+            // A hangup may come alone (e.g. a pipe whose writers are all closed),
+            // readers must wake up too to see the end of file.
+            if (mask & (EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLHUP))
                 ev.flags |= selector::events::input;
-            if (mask & (EPOLLOUT | EPOLLHUP)) // is this correct? :(
+            if (mask & (EPOLLOUT | EPOLLHUP))
                 ev.flags |= selector::events::output;
         }
 
@@ -0,0 +1,331 @@
+#include "rio/shm_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include "rio/event_loop.hpp"
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+static constexpr std::uint64_t RING_MAGIC = 0x72696f2d72696e67; // "rio-ring"
+
+// Messages are a 4 byte length followed by the payload, padded to 8 bytes.
+static constexpr std::size_t RECORD_ALIGNMENT = 8;
+static constexpr std::size_t LENGTH_SIZE = sizeof(std::uint32_t);
+
+static std::size_t record_size(std::size_t n) noexcept {
+    return (LENGTH_SIZE + n + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+static std::size_t page_size() noexcept {
+    return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// First page of the memfd, the data follows. Positions only grow, the offset
+// in the data is the position modulo the capacity.
+struct shm_ring::header {
+    // Written by create() through the memfd, see attach.
+    std::uint64_t magic;
+    std::uint64_t capacity;
+
+    // Written by the consumer only.
+    alignas(64) std::atomic<std::uint64_t> head;
+    // Written by the producer only.
+    alignas(64) std::atomic<std::uint64_t> tail;
+
+    alignas(64) std::atomic<std::uint32_t> producer_waiting;
+    std::atomic<std::uint32_t> closed;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+shm_ring shm_ring::create(std::size_t capacity) {
+    auto page = page_size();
+    capacity = std::bit_ceil(std::max(capacity, page));
+
+    int memfd = ::memfd_create("rio-shm-ring", MFD_CLOEXEC);
+    if (memfd == -1)
+        THROW_ERRNO("shm_ring: memfd_create");
+
+    int data_efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int space_efd = data_efd == -1 ? -1 : ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (space_efd == -1 || ::ftruncate(memfd, static_cast<off_t>(page + capacity)) == -1) {
+        int saved = errno;
+        ::close(memfd);
+        if (data_efd != -1)
+            ::close(data_efd);
+        if (space_efd != -1)
+            ::close(space_efd);
+        errno = saved;
+        THROW_ERRNO("shm_ring: create");
+    }
+
+    // The memfd is zero-filled, so only the header's constants need writing
+    // before the mapping.
+    std::uint64_t constants[2] = { RING_MAGIC, capacity };
+    if (::pwrite(memfd, constants, sizeof(constants), 0) == -1) {
+        int saved = errno;
+        ::close(memfd);
+        ::close(data_efd);
+        ::close(space_efd);
+        errno = saved;
+        THROW_ERRNO("shm_ring: pwrite");
+    }
+
+    return shm_ring { memfd, data_efd, space_efd };
+}
+
+shm_ring shm_ring::attach(int memfd, int data_efd, int space_efd) {
+    return shm_ring { memfd, data_efd, space_efd };
+}
+
+shm_ring::shm_ring(int memfd, int data_efd, int space_efd)
+    : memfd_(memfd), data_efd_(data_efd), space_efd_(space_efd)
+{
+    auto page = page_size();
+
+    struct stat st;
+    if (::fstat(memfd_, &st) == -1) {
+        int saved = errno;
+        reset();
+        errno = saved;
+        THROW_ERRNO("shm_ring: fstat");
+    }
+
+    std::uint64_t constants[2] = {};
+    if (::pread(memfd_, constants, sizeof(constants), 0) != sizeof(constants) ||
+        constants[0] != RING_MAGIC ||
+        !std::has_single_bit(constants[1]) ||
+        static_cast<std::uint64_t>(st.st_size) != page + constants[1]) {
+        reset();
+        throw std::invalid_argument("shm_ring: not a ring");
+    }
+    capacity_ = constants[1];
+
+    // Header and data, then the data again right after, so a message that
+    // wraps around the end is still contiguous.
+    mapping_size_ = page + 2 * capacity_;
+    mapping_ = ::mmap(nullptr, mapping_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        int saved = errno;
+        reset();
+        errno = saved;
+        THROW_ERRNO("shm_ring: mmap");
+    }
+
+    auto base = static_cast<std::byte*>(mapping_);
+    if (::mmap(base, page + capacity_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, memfd_, 0) == MAP_FAILED ||
+        ::mmap(base + page + capacity_, capacity_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, memfd_, static_cast<off_t>(page)) == MAP_FAILED) {
+        int saved = errno;
+        reset();
+        errno = saved;
+        THROW_ERRNO("shm_ring: mmap");
+    }
+
+    header_ = std::launder(reinterpret_cast<header*>(base));
+    data_ = base + page;
+}
+
+shm_ring::~shm_ring() {
+    reset();
+}
+
+shm_ring::shm_ring(shm_ring&& other) noexcept
+    : memfd_(std::exchange(other.memfd_, -1)),
+      data_efd_(std::exchange(other.data_efd_, -1)),
+      space_efd_(std::exchange(other.space_efd_, -1)),
+      mapping_(std::exchange(other.mapping_, nullptr)),
+      mapping_size_(std::exchange(other.mapping_size_, 0)),
+      header_(std::exchange(other.header_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      pending_(std::exchange(other.pending_, 0)),
+      data_registered_(std::exchange(other.data_registered_, false)),
+      space_registered_(std::exchange(other.space_registered_, false)) { }
+
+shm_ring& shm_ring::operator=(shm_ring&& other) noexcept {
+    if (this != &other) {
+        reset();
+        memfd_ = std::exchange(other.memfd_, -1);
+        data_efd_ = std::exchange(other.data_efd_, -1);
+        space_efd_ = std::exchange(other.space_efd_, -1);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+        mapping_size_ = std::exchange(other.mapping_size_, 0);
+        header_ = std::exchange(other.header_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        capacity_ = std::exchange(other.capacity_, 0);
+        pending_ = std::exchange(other.pending_, 0);
+        data_registered_ = std::exchange(other.data_registered_, false);
+        space_registered_ = std::exchange(other.space_registered_, false);
+    }
+    return *this;
+}
+
+void shm_ring::reset() noexcept {
+    if (auto loop = event_loop_t::get_or_null()) {
+        if (data_registered_)
+            (void) loop->try_del_fd(data_efd_);
+        if (space_registered_)
+            (void) loop->try_del_fd(space_efd_);
+    }
+    data_registered_ = space_registered_ = false;
+
+    if (mapping_)
+        ::munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    header_ = nullptr;
+    data_ = nullptr;
+
+    for (int* fd : { &memfd_, &data_efd_, &space_efd_ }) {
+        if (*fd != -1)
+            ::close(*fd);
+        *fd = -1;
+    }
+}
+
+std::size_t shm_ring::max_message_size() const noexcept {
+    // Lengths are stored in 32 bits, rings of 4 GiB and more hold more.
+    return std::min<std::size_t>(capacity_ - LENGTH_SIZE, UINT32_MAX);
+}
+
+bool shm_ring::closed() const noexcept {
+    return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+void shm_ring::signal(int efd) noexcept {
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto r = ::write(efd, &one, sizeof(one));
+}
+
+bool shm_ring::try_send(std::span<const std::byte> msg) {
+    if (msg.size() > max_message_size()) [[unlikely]]
+        throw std::invalid_argument("shm_ring: message larger than the ring");
+    if (closed()) [[unlikely]]
+        throw std::system_error(EPIPE, std::system_category(), "shm_ring: send");
+
+    auto need = record_size(msg.size());
+    // seq_cst pairs with the consumer storing head and then checking
+    // producer_waiting, see send().
+    auto tail = header_->tail.load(std::memory_order_relaxed);
+    auto head = header_->head.load(std::memory_order_seq_cst);
+    if (capacity_ - (tail - head) < need)
+        return false;
+
+    auto record = data_ + (tail & (capacity_ - 1));
+    auto length = static_cast<std::uint32_t>(msg.size());
+    std::memcpy(record, &length, LENGTH_SIZE);
+    std::memcpy(record + LENGTH_SIZE, msg.data(), msg.size());
+
+    // Pairs with the consumer storing head and then loading tail before it
+    // sleeps: either it sees this message, or this sees the ring was empty.
+    header_->tail.store(tail + need, std::memory_order_seq_cst);
+    if (header_->head.load(std::memory_order_seq_cst) == tail)
+        signal(data_efd_);
+    return true;
+}
+
+task<> shm_ring::send(std::span<const std::byte> msg) {
+    auto& loop = get_event_loop();
+    for (;;) {
+        if (try_send(msg))
+            co_return;
+
+        // Ask the consumer to signal once it frees space, then check again
+        // in case it did so before seeing the request.
+        drain(space_efd_, space_registered_);
+        header_->producer_waiting.store(1, std::memory_order_seq_cst);
+        if (try_send(msg)) {
+            header_->producer_waiting.store(0, std::memory_order_relaxed);
+            co_return;
+        }
+
+        co_await loop.await_read(space_efd_);
+    }
+}
+
+void shm_ring::release() noexcept {
+    if (pending_ == 0)
+        return;
+
+    auto head = header_->head.load(std::memory_order_relaxed);
+    header_->head.store(head + pending_, std::memory_order_seq_cst);
+    pending_ = 0;
+
+    if (header_->producer_waiting.load(std::memory_order_seq_cst) &&
+        header_->producer_waiting.exchange(0, std::memory_order_seq_cst))
+        signal(space_efd_);
+}
+
+std::optional<std::span<const std::byte>> shm_ring::try_recv() {
+    release();
+
+    auto head = header_->head.load(std::memory_order_relaxed);
+    auto tail = header_->tail.load(std::memory_order_seq_cst);
+    if (tail == head)
+        return std::nullopt;
+
+    // The producer shares the memory, don't read past what it published.
+    auto record = data_ + (head & (capacity_ - 1));
+    std::uint32_t length;
+    std::memcpy(&length, record, LENGTH_SIZE);
+    if (tail - head > capacity_ || record_size(length) > tail - head) [[unlikely]]
+        throw std::system_error(EBADMSG, std::system_category(), "shm_ring: recv");
+    pending_ = record_size(length);
+    return std::span<const std::byte> { record + LENGTH_SIZE, length };
+}
+
+task<std::optional<std::span<const std::byte>>> shm_ring::recv() {
+    auto& loop = get_event_loop();
+    for (;;) {
+        if (auto msg = try_recv())
+            co_return msg;
+
+        // Signals consumed here were for messages the check above may have
+        // missed, so check once more before sleeping.
+        drain(data_efd_, data_registered_);
+        if (auto msg = try_recv())
+            co_return msg;
+        if (closed())
+            co_return std::nullopt;
+
+        co_await loop.await_read(data_efd_);
+    }
+}
+
+void shm_ring::drain(int efd, bool& registered) {
+    if (!registered) {
+        get_event_loop().add_fd(efd, file_ops::readable);
+        registered = true;
+    }
+
+    std::uint64_t count;
+    [[maybe_unused]] auto r = ::read(efd, &count, sizeof(count));
+}
+
+void shm_ring::shutdown() noexcept {
+    header_->closed.store(1, std::memory_order_seq_cst);
+    signal(data_efd_);
+    signal(space_efd_);
+}
+
+}
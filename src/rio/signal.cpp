@@ -0,0 +1,143 @@
+#include "rio/event_loop.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <format>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/signalfd.h>
+#include <system_error>
+#include <unistd.h>
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+event_loop_t::signal_internal::~signal_internal() {
+    if (fd_ == -1)
+        return;
+
+    ::close(fd_);
+
+    // Watched signals still pending would run their default action once
+    // unblocked, killing the process on its way out. Only the ones the old
+    // mask lets through are discarded.
+    sigset_t pending;
+    sigemptyset(&pending);
+    for (int signo = 1; signo < NSIG; signo++) {
+        if (sigismember(&mask_, signo) == 1 && sigismember(&old_mask_, signo) == 0)
+            sigaddset(&pending, signo);
+    }
+    timespec zero {};
+    while (sigtimedwait(&pending, nullptr, &zero) > 0) { }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask_, nullptr);
+}
+
+event_loop_t::signal_internal& event_loop_t::watch_signal(int signo) {
+    if (signo <= 0 || signo >= NSIG || signo == SIGKILL || signo == SIGSTOP)
+        throw std::invalid_argument(std::format("signal {} can't be watched", signo));
+
+    if (!signals_) {
+        auto signals = std::make_unique<signal_internal>();
+        sigemptyset(&signals->mask_);
+
+        int fd = signalfd(-1, &signals->mask_, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (fd == -1)
+            THROW_ERRNO("watch_signal: signalfd");
+
+        try {
+            add_fd(fd, file_ops::readable, on_signalfd, this);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+
+        pthread_sigmask(SIG_BLOCK, nullptr, &signals->old_mask_);
+        signals->fd_ = fd;
+        signals_ = std::move(signals);
+    }
+
+    auto& signals = *signals_;
+    if (sigismember(&signals.mask_, signo))
+        return signals;
+
+    sigaddset(&signals.mask_, signo);
+
+    // Block the signal before updating the signalfd, so a delivery in
+    // between stays pending instead of running the default action.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    if (int err = pthread_sigmask(SIG_BLOCK, &set, nullptr); err != 0) {
+        errno = err;
+        THROW_ERRNO("watch_signal: pthread_sigmask");
+    }
+
+    if (signalfd(signals.fd_, &signals.mask_, 0) == -1)
+        THROW_ERRNO("watch_signal: signalfd");
+
+    return signals;
+}
+
+void event_loop_t::on_signalfd(void* ctx, selector::events) {
+    auto& loop = *static_cast<event_loop_t*>(ctx);
+    auto& signals = *loop.signals_;
+
+    signalfd_siginfo infos[16];
+    for (;;) {
+        ssize_t n = ::read(signals.fd_, infos, sizeof(infos));
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            THROW_ERRNO("on_signalfd: read");
+        }
+
+        for (size_t i = 0; i < n / sizeof(signalfd_siginfo); i++) {
+            int signo = static_cast<int>(infos[i].ssi_signo);
+
+            if (auto handler = signals.handlers_[signo])
+                handler(signo);
+
+            // Resumed by priority like fd waiters, they may wait again then.
+            auto& waiters = signals.waiters_[signo];
+            for (auto& w : waiters) {
+                loop.unref();
+                loop.ready_[static_cast<size_t>(w.prio)].emplace_back(w.coro, loop.loop_time_);
+            }
+            waiters.clear();
+        }
+    }
+}
+
+void event_loop_t::signal_awaiter::await_suspend(std::coroutine_handle<> coro) {
+    auto& signals = loop_.watch_signal(signo_);
+    signals.waiters_[signo_].push_back({ coro, prio_ });
+    loop_.ref();
+}
+
+void event_loop_t::on_signal(int signo, signal_handler_t handler) {
+    if (!handler)
+        throw std::invalid_argument("on_signal: handler must not be null");
+
+    auto& signals = watch_signal(signo);
+    if (!signals.handlers_[signo])
+        ref();
+    signals.handlers_[signo] = handler;
+}
+
+void event_loop_t::remove_signal_handler(int signo) {
+    if (!signals_ || signo <= 0 || signo >= NSIG || !signals_->handlers_[signo])
+        return;
+
+    signals_->handlers_[signo] = nullptr;
+    unref();
+}
+
+}
@@ -0,0 +1,76 @@
+#include "rio/simulation.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include "rio/common/event_loop_exceptions.hpp"
+
+namespace rio {
+
+void simulation::inject(int fd, selector::events ev) {
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [fd](auto const& p) { return p.fd == fd; });
+    if (it != pending_.end())
+        it->flags |= ev;
+    else
+        pending_.push_back({ .fd = fd, .flags = ev });
+}
+
+void simulation::add_fd(int fd, selector::events ev, trigger_mode mode, std::uint32_t tag) {
+    if (!fds_.try_emplace(fd, registration { ev, mode, tag }).second)
+        throw std::invalid_argument(std::format("simulation: fd {} is already registered", fd));
+}
+
+void simulation::modify_fd(int fd, selector::events ev, trigger_mode mode, std::uint32_t tag) {
+    auto it = fds_.find(fd);
+    if (it == fds_.end())
+        throw std::invalid_argument(std::format("simulation: fd {} is not registered", fd));
+    it->second = { ev, mode, tag };
+}
+
+void simulation::del_fd(int fd) {
+    if (fds_.erase(fd) == 0)
+        throw std::invalid_argument(std::format("simulation: fd {} is not registered", fd));
+
+    std::erase_if(pending_, [fd](auto const& p) { return p.fd == fd; });
+}
+
+int simulation::wait(std::vector<selector::event_data>& data, std::optional<time_type> timeout) {
+    int n = 0;
+
+    // Readiness the fd isn't interested in stays pending, as it would with a
+    // real fd whose interest is re-armed later.
+    for (auto& p : pending_) {
+        auto it = fds_.find(p.fd);
+        if (it == fds_.end())
+            continue;
+
+        auto& reg = it->second;
+        auto flags = p.flags & reg.interest;
+        // Like EPOLLERR, errors can't be masked, and the real selector
+        // reports them as every direction.
+        if (p.flags & selector::events::error)
+            flags = selector::events::input | selector::events::output | selector::events::error;
+        if (!flags)
+            continue;
+
+        data.push_back({ .fd = p.fd, .flags = flags, .tag = reg.tag });
+        p.flags &= ~flags;
+        n++;
+
+        if (reg.mode == trigger_mode::oneshot)
+            reg.interest = selector::events::none;
+    }
+    std::erase_if(pending_, [](auto const& p) { return !p.flags; });
+
+    if (n > 0)
+        return n;
+
+    if (!timeout)
+        throw simulation_stalled_exception();
+
+    advance(*timeout);
+    return 0;
+}
+
+}
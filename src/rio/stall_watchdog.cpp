@@ -0,0 +1,157 @@
+#include "rio/stall_watchdog.hpp"
+
+#include <cerrno>
+#include <execinfo.h>
+#include <stdexcept>
+#include <system_error>
+#include "rio/event_loop.hpp"
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Deepest stack sample taken.
+constexpr int MAX_FRAMES = 64;
+
+// How long the watchdog waits for the loop thread to take a sample.
+constexpr time_type SAMPLE_TIMEOUT = time_type::from_ms(100);
+
+// Filled by the loop thread in the signal handler, hence a single watchdog.
+static std::atomic<stall_watchdog*> instance { nullptr };
+static void* sample_frames[MAX_FRAMES];
+static std::atomic<int> sample_size { -1 };
+
+static void on_sample_signal(int) {
+    int saved_errno = errno;
+    sample_size.store(backtrace(sample_frames, MAX_FRAMES), std::memory_order_release);
+    errno = saved_errno;
+}
+
+stall_watchdog::stall_watchdog(event_loop_t& loop, time_type threshold, int sample_signal)
+    : loop_(loop), threshold_(threshold), sample_signal_(sample_signal), loop_thread_(pthread_self())
+{
+    if (threshold_.as_ns() <= 0)
+        throw std::invalid_argument("stall_watchdog: threshold must be > 0");
+
+    stall_watchdog* expected = nullptr;
+    if (!instance.compare_exchange_strong(expected, this))
+        throw std::logic_error("stall_watchdog: only one watchdog may exist at a time");
+
+    // backtrace() loads libgcc on its first call, which isn't safe in a handler.
+    void* frame;
+    backtrace(&frame, 1);
+
+    struct sigaction action {};
+    action.sa_handler = on_sample_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(sample_signal_, &action, &old_action_) == -1) {
+        instance.store(nullptr);
+        THROW_ERRNO("stall_watchdog: sigaction");
+    }
+
+    loop_.watchdog_ = this;
+    thread_ = std::thread([this] { watch(); });
+}
+
+stall_watchdog::~stall_watchdog() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+
+    loop_.watchdog_ = nullptr;
+    sigaction(sample_signal_, &old_action_, nullptr);
+    instance.store(nullptr);
+}
+
+void stall_watchdog::on_stall(stall_handler_t handler, void* ctx) {
+    std::lock_guard lock(mutex_);
+    handler_ = handler;
+    handler_ctx_ = ctx;
+}
+
+std::vector<std::pair<void*, std::uint64_t>> stall_watchdog::stall_counts() const {
+    std::lock_guard lock(mutex_);
+    return { counts_.begin(), counts_.end() };
+}
+
+std::uint64_t stall_watchdog::total_stalls() const {
+    std::lock_guard lock(mutex_);
+    return total_;
+}
+
+void stall_watchdog::watch() {
+    auto interval = std::chrono::nanoseconds(threshold_.as_ns() / 4 + 1);
+    std::uint64_t reported = 0;
+
+    std::unique_lock lock(mutex_);
+    while (!cv_.wait_for(lock, interval, [this] { return stop_; })) {
+        auto beat = heartbeat_.load(std::memory_order_acquire);
+        bool dispatching = beat & 1;
+        if (!dispatching || beat == reported)
+            continue;
+
+        // Both belong to this dispatch only if the beat didn't move meanwhile.
+        auto entered_at = time_type::from_ns(entered_at_.load(std::memory_order_relaxed));
+        void* source = source_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (heartbeat_.load(std::memory_order_relaxed) != beat)
+            continue;
+
+        auto duration = time_type::monotonic_clock() - entered_at;
+        if (duration >= threshold_) {
+            reported = beat;
+            lock.unlock();
+            report(source, duration, beat);
+            lock.lock();
+        }
+    }
+}
+
+std::vector<void*> stall_watchdog::sample_stack(std::uint64_t beat) {
+    sample_size.store(-1, std::memory_order_relaxed);
+    if (pthread_kill(loop_thread_, sample_signal_) != 0)
+        return {};
+
+    auto deadline = time_type::monotonic_clock() + SAMPLE_TIMEOUT;
+    int n;
+    while ((n = sample_size.load(std::memory_order_acquire)) == -1) {
+        if (time_type::monotonic_clock() >= deadline)
+            return {};
+        std::this_thread::yield();
+    }
+
+    // Taken after the dispatch finished, it would point somewhere else.
+    if (heartbeat_.load(std::memory_order_acquire) != beat)
+        return {};
+    return std::vector<void*>(sample_frames, sample_frames + n);
+}
+
+void stall_watchdog::report(void* source, time_type duration, std::uint64_t beat) {
+    stall_report r {
+        .source = source,
+        .duration = duration,
+        .stack = sample_stack(beat)
+    };
+
+    stall_handler_t handler;
+    void* ctx;
+    {
+        std::lock_guard lock(mutex_);
+        counts_[source]++;
+        total_++;
+        handler = handler_;
+        ctx = handler_ctx_;
+    }
+
+    if (handler)
+        handler(ctx, r);
+}
+
+}
@@ -0,0 +1,252 @@
+#include "rio/udp.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include "rio/event_loop.hpp"
+#include "tsl/macros.hpp"
+
+// Older libc headers don't know about UDP GSO/GRO.
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+using std::size_t;
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Room for a UDP_GRO/UDP_SEGMENT cmsg plus a few more, so enabling other
+// ancillary data on the socket doesn't immediately truncate it.
+constexpr size_t CONTROL_SIZE = 64;
+
+struct udp_batch::slot {
+    iovec iov;
+    sockaddr_storage addr;
+    alignas(cmsghdr) unsigned char control[CONTROL_SIZE];
+    std::uint16_t segment_size;
+};
+
+udp_batch::udp_batch(size_t capacity, size_t buffer_size)
+    : capacity_(capacity), buffer_size_(buffer_size), size_(0)
+{
+    if (capacity_ == 0)
+        throw std::invalid_argument("udp_batch: capacity must be > 0");
+    if (buffer_size_ == 0)
+        throw std::invalid_argument("udp_batch: buffer_size must be > 0");
+
+    slots_ = std::make_unique<slot[]>(capacity_);
+    msgs_ = std::make_unique<mmsghdr[]>(capacity_);
+    buffers_ = std::make_unique<std::byte[]>(capacity_ * buffer_size_);
+
+    for (size_t i = 0; i < capacity_; i++) {
+        slots_[i].iov.iov_base = buffers_.get() + i * buffer_size_;
+        slots_[i].iov.iov_len = buffer_size_;
+        slots_[i].segment_size = 0;
+
+        auto& hdr = msgs_[i].msg_hdr;
+        hdr.msg_iov = &slots_[i].iov;
+        hdr.msg_iovlen = 1;
+    }
+}
+
+udp_batch::~udp_batch() = default;
+udp_batch::udp_batch(udp_batch&&) noexcept = default;
+udp_batch& udp_batch::operator=(udp_batch&&) noexcept = default;
+
+std::span<std::byte> udp_batch::data(size_t i) const noexcept {
+    TSL_ASSERT(i < size_);
+    return { static_cast<std::byte*>(slots_[i].iov.iov_base), slots_[i].iov.iov_len };
+}
+
+sockaddr const* udp_batch::address(size_t i) const noexcept {
+    TSL_ASSERT(i < size_);
+    if (msgs_[i].msg_hdr.msg_namelen == 0)
+        return nullptr;
+    return reinterpret_cast<sockaddr const*>(&slots_[i].addr);
+}
+
+socklen_t udp_batch::address_len(size_t i) const noexcept {
+    TSL_ASSERT(i < size_);
+    return msgs_[i].msg_hdr.msg_namelen;
+}
+
+std::uint16_t udp_batch::segment_size(size_t i) const noexcept {
+    TSL_ASSERT(i < size_);
+    return slots_[i].segment_size;
+}
+
+bool udp_batch::truncated(size_t i) const noexcept {
+    TSL_ASSERT(i < size_);
+    return msgs_[i].msg_hdr.msg_flags & MSG_TRUNC;
+}
+
+bool udp_batch::push(std::span<const std::byte> payload, sockaddr const* addr,
+                     socklen_t addr_len, std::uint16_t segment_size) noexcept {
+    if (full() || payload.size() > buffer_size_ || addr_len > sizeof(sockaddr_storage))
+        return false;
+
+    auto& s = slots_[size_];
+    auto& hdr = msgs_[size_].msg_hdr;
+
+    std::memcpy(s.iov.iov_base, payload.data(), payload.size());
+    s.iov.iov_len = payload.size();
+    s.segment_size = segment_size;
+
+    if (addr) {
+        std::memcpy(&s.addr, addr, addr_len);
+        hdr.msg_name = &s.addr;
+        hdr.msg_namelen = addr_len;
+    } else {
+        hdr.msg_name = nullptr;
+        hdr.msg_namelen = 0;
+    }
+
+    if (segment_size) {
+        hdr.msg_control = s.control;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+
+        cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+        std::memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+    } else {
+        hdr.msg_control = nullptr;
+        hdr.msg_controllen = 0;
+    }
+
+    size_++;
+    return true;
+}
+
+void udp_batch::prepare_recv() noexcept {
+    for (size_t i = 0; i < capacity_; i++) {
+        auto& s = slots_[i];
+        auto& hdr = msgs_[i].msg_hdr;
+
+        s.iov.iov_len = buffer_size_;
+        hdr.msg_name = &s.addr;
+        hdr.msg_namelen = sizeof(s.addr);
+        hdr.msg_control = s.control;
+        hdr.msg_controllen = sizeof(s.control);
+        hdr.msg_flags = 0;
+    }
+    size_ = 0;
+}
+
+void udp_batch::finish_recv(size_t n) noexcept {
+    for (size_t i = 0; i < n; i++) {
+        auto& s = slots_[i];
+        auto& hdr = msgs_[i].msg_hdr;
+
+        s.iov.iov_len = msgs_[i].msg_len;
+        s.segment_size = 0;
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                int gso_size;
+                std::memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+                s.segment_size = static_cast<std::uint16_t>(gso_size);
+            }
+        }
+    }
+    size_ = n;
+}
+
+// Removes the first n messages, moving the others to the front. Slots are
+// swapped rather than copied, so each keeps its own payload buffer.
+void udp_batch::drop_front(size_t n) noexcept {
+    TSL_ASSERT(n <= size_);
+    for (size_t i = n; i < size_; i++) {
+        std::swap(slots_[i - n], slots_[i]);
+        std::swap(msgs_[i - n], msgs_[i]);
+    }
+    size_ -= n;
+
+    // The headers point into their slots, which stayed in place.
+    for (size_t i = 0; i < size_; i++) {
+        auto& hdr = msgs_[i].msg_hdr;
+        hdr.msg_iov = &slots_[i].iov;
+        if (hdr.msg_name)
+            hdr.msg_name = &slots_[i].addr;
+        if (hdr.msg_control)
+            hdr.msg_control = slots_[i].control;
+    }
+}
+
+task<size_t> async_recv_batch(int fd, udp_batch& batch) {
+    batch.prepare_recv();
+
+    for (;;) {
+        int n = recvmmsg(fd, batch.msgs_.get(), batch.capacity_, MSG_DONTWAIT, nullptr);
+        if (n >= 0) {
+            batch.finish_recv(n);
+            co_return n;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            THROW_ERRNO("async_recv_batch: recvmmsg");
+
+        co_await get_event_loop().await_read(fd);
+    }
+}
+
+task<size_t> async_send_batch(int fd, udp_batch& batch) {
+    size_t sent = 0;
+
+    while (sent < batch.size_) {
+        int n = sendmmsg(fd, batch.msgs_.get() + sent, batch.size_ - sent, MSG_DONTWAIT);
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            // The error belongs to the first unsent datagram, report the
+            // ones that went out before it instead, and keep the rest.
+            if (sent > 0) {
+                batch.drop_front(sent);
+                co_return sent;
+            }
+            THROW_ERRNO("async_send_batch: sendmmsg");
+        }
+
+        co_await get_event_loop().await_write(fd);
+    }
+
+    batch.clear();
+    co_return sent;
+}
+
+void set_udp_gso(int fd, std::uint16_t segment_size) {
+    int value = segment_size;
+    if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, sizeof(value)) == -1)
+        THROW_ERRNO("set_udp_gso: setsockopt(UDP_SEGMENT)");
+}
+
+void set_udp_gro(int fd, bool enabled) {
+    int value = enabled;
+    if (setsockopt(fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) == -1)
+        THROW_ERRNO("set_udp_gro: setsockopt(UDP_GRO)");
+}
+
+}
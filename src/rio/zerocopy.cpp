@@ -0,0 +1,195 @@
+#include "rio/zerocopy.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <system_error>
+#include "rio/event_loop.hpp"
+
+// Older libc headers don't know about MSG_ZEROCOPY.
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+using std::size_t;
+
+[[noreturn]] static void throw_errno(const char* what) {
+    throw std::system_error(errno, std::system_category(), what);
+}
+#define THROW_ERRNO(msg) [[unlikely]] ::throw_errno(msg)
+
+namespace rio {
+
+// Zerocopy ids wrap around, compare them like TCP sequence numbers.
+static bool id_before(std::uint32_t a, std::uint32_t b) noexcept {
+    return static_cast<std::int32_t>(a - b) < 0;
+}
+
+std::uint32_t event_loop_t::zerocopy_sent(int fd) {
+    ensure_fd_registered(fd);
+    return files_[fd].zc_next_++;
+}
+
+bool event_loop_t::zerocopy_copied(int fd) const {
+    ensure_fd_registered(fd);
+    return files_[fd].zc_copied_;
+}
+
+bool event_loop_t::zerocopy_done(int fd, std::uint32_t id) const noexcept {
+    if (fd < 0 || static_cast<size_t>(fd) >= max_fileno_ || !files_[fd].is_valid())
+        return true;
+    return id_before(id, files_[fd].zc_done_);
+}
+
+void event_loop_t::zerocopy_awaiter::await_suspend(std::coroutine_handle<> coro) {
+    loop_.ensure_fd_registered(fd_);
+
+    // EPOLLERR can't be masked, but a oneshot fd reports nothing until re-armed.
+    auto& file = loop_.files_[fd_];
+    if (!file.registered_) {
+        if (auto ec = loop_.register_fd(file))
+            throw std::system_error(ec, "selector: add_fd: epoll_ctl");
+    }
+    else if (file.mode_ == trigger_mode::oneshot)
+        loop_.modify_interest(file, file.interest_);
+    file.zc_waiting_.push_back({ coro, prio_, id_ });
+}
+
+// Drains the error queue and wakes the senders whose pages were released.
+// Returns the events left to dispatch for the fd: none when the EPOLLERR came
+// from completions only, every direction when a real error is pending.
+selector::events event_loop_t::reap_zerocopy(file_internal& file, time_type current_time) {
+    bool other_error = false;
+
+    for (;;) {
+        alignas(cmsghdr) unsigned char control[128];
+        msghdr msg {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(file.fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                        || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr)
+                continue;
+
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                other_error = true;
+                continue;
+            }
+
+            // The notification covers the ids [ee_info, ee_data].
+            std::uint32_t end = err.ee_data + 1;
+            if (id_before(file.zc_done_, end))
+                file.zc_done_ = end;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                file.zc_copied_ = true;
+        }
+    }
+
+    std::erase_if(file.zc_waiting_, [&](auto const& w) {
+        if (!id_before(w.id, file.zc_done_))
+            return false;
+        ready_[static_cast<size_t>(w.prio)].emplace_back(w.coro, current_time);
+        return true;
+    });
+
+    const auto all = selector::events::input | selector::events::output
+                       | selector::events::error;
+    if (other_error)
+        return all;
+
+    // With the error queue empty, POLLERR means a pending socket error. The
+    // selector folded the real readiness into the error, ask for it again.
+    pollfd pfd { file.fd_, POLLIN | POLLOUT | POLLRDHUP, 0 };
+    while (::poll(&pfd, 1, 0) == -1) {
+        if (errno != EINTR)
+            return all;
+    }
+    if (pfd.revents & (POLLERR | POLLNVAL))
+        return all;
+
+    auto flags = selector::events::none;
+    if (pfd.revents & (POLLIN | POLLRDHUP | POLLHUP))
+        flags |= selector::events::input;
+    if (pfd.revents & (POLLOUT | POLLHUP))
+        flags |= selector::events::output;
+    return flags;
+}
+
+bool set_zerocopy(int fd, bool enabled) {
+    int value = enabled;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) == -1) {
+        // Older kernels and other socket types don't support it.
+        if (errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+            return false;
+        THROW_ERRNO("set_zerocopy: setsockopt(SO_ZEROCOPY)");
+    }
+    return true;
+}
+
+// Without SO_ZEROCOPY the kernel ignores MSG_ZEROCOPY, and never reports a
+// completion for the send.
+static bool zerocopy_enabled(int fd) noexcept {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    return getsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &value, &len) == 0 && value;
+}
+
+task<size_t> async_send_zerocopy(int fd, std::span<const std::byte> buf, size_t min_size) {
+    auto& loop = get_event_loop();
+    size_t sent = 0;
+    bool zerocopy = false;
+    bool copy_only = buf.size() < min_size || !zerocopy_enabled(fd);
+    std::uint32_t last_id = 0;
+
+    while (sent < buf.size()) {
+        size_t left = buf.size() - sent;
+        int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        bool use_zerocopy = !copy_only && left >= min_size && !loop.zerocopy_copied(fd);
+        if (use_zerocopy)
+            flags |= MSG_ZEROCOPY;
+
+        ssize_t n = ::send(fd, buf.data() + sent, left, flags);
+        if (n >= 0) {
+            if (use_zerocopy) {
+                last_id = loop.zerocopy_sent(fd);
+                zerocopy = true;
+            }
+            sent += n;
+            continue;
+        }
+
+        if (errno == EINTR)
+            continue;
+        // Out of optmem for the notifications, or refused, copy the rest.
+        if ((errno == ENOBUFS || errno == EINVAL || errno == EOPNOTSUPP) && use_zerocopy) {
+            copy_only = true;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            THROW_ERRNO("async_send_zerocopy: send");
+
+        co_await loop.await_write(fd);
+    }
+
+    if (zerocopy)
+        co_await loop.await_zerocopy(fd, last_id);
+    co_return sent;
+}
+
+}
@@ -77,10 +77,19 @@ task<> funcao2() {
     }
 }
 
+task<> funcao3() {
+    periodic_timer timer { 100ms };
+    for(int i = 0; i < 3; i++) {
+        auto ticks = co_await timer;
+        cout << "Tick: " << ticks << "\n";
+    }
+}
+
 int main() {
     event_loop_t loop;
     loop.schedule(funcao);
     loop.schedule(funcao2);
+    loop.schedule(funcao3);
 
     loop.run();
     return 0;
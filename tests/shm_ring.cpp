@@ -0,0 +1,105 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "rio/event_loop.hpp"
+#include "rio/shm_ring.hpp"
+#include "rio/task.hpp"
+
+using namespace std;
+using namespace rio;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+            failures++; \
+        } \
+    } while (0)
+
+// Enough messages, and large enough, to fill the ring many times over, so
+// both sides have to wait for each other.
+constexpr int num_messages = 2000;
+constexpr size_t ring_capacity = 4096;
+
+static size_t message_size(int i) {
+    return 1 + (i * 37) % 1500;
+}
+
+static void fill(byte* buf, int i, size_t size) {
+    for (size_t j = 0; j < size; j++)
+        buf[j] = static_cast<byte>(i + j);
+}
+
+task<> producer(shm_ring ring) {
+    byte buf[1500];
+    for (int i = 0; i < num_messages; i++) {
+        auto size = message_size(i);
+        fill(buf, i, size);
+        co_await ring.send({ buf, size });
+    }
+    ring.shutdown();
+
+    bool threw = false;
+    try {
+        co_await ring.send({ buf, 1 });
+    } catch (system_error const& e) {
+        threw = e.code().value() == EPIPE;
+    }
+    CHECK(threw);
+}
+
+task<> consumer(shm_ring ring) {
+    byte expected[1500];
+    int received = 0;
+
+    while (auto msg = co_await ring.recv()) {
+        auto size = message_size(received);
+        fill(expected, received, size);
+        CHECK(msg->size() == size);
+        CHECK(memcmp(msg->data(), expected, size) == 0);
+        ring.release();
+        received++;
+    }
+    CHECK(received == num_messages);
+}
+
+int main() {
+    auto ring = shm_ring::create(ring_capacity);
+    CHECK(ring.capacity() >= ring_capacity);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+
+    if (pid == 0) {
+        event_loop_t loop;
+        loop.schedule_a(consumer(std::move(ring)));
+        loop.run();
+        _exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    {
+        event_loop_t loop;
+        loop.schedule_a(producer(std::move(ring)));
+        loop.run();
+    }
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+    if (failures) {
+        cerr << failures << " check(s) failed\n";
+        return EXIT_FAILURE;
+    }
+    cout << "shm_ring: all checks passed\n";
+    return EXIT_SUCCESS;
+}
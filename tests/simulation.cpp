@@ -0,0 +1,192 @@
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include "rio/event_loop.hpp"
+#include "rio/simulation.hpp"
+#include "rio/task.hpp"
+
+using namespace std;
+using namespace rio;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+            failures++; \
+        } \
+    } while (0)
+
+// Cached readiness: a coroutine that finds its direction ready doesn't need
+// another edge, but one that waits with await_read does.
+task<> readiness_waiter(int& stage) {
+    auto& loop = get_event_loop();
+
+    co_await loop.await_read(10);
+    stage = 1;
+    CHECK(bool(loop.readiness(10) & file_ops::readable));
+
+    auto before = loop.now();
+    co_await loop.await_readable(10);
+    CHECK(loop.now().as_ns() == before.as_ns());
+    stage = 2;
+
+    co_await loop.await_read(10);
+    CHECK(loop.now().as_ns() == time_type::from_sec(2).as_ns());
+    CHECK(!(loop.readiness(10) & file_ops::writable));
+    stage = 3;
+
+    loop.del_fd(10);
+}
+
+void check_readiness() {
+    simulation sim;
+    event_loop_t loop { sim };
+    int stage = 0;
+
+    loop.add_fd(10, file_ops::readable | file_ops::writable);
+    // Lazy registration: the fd only enters the selector once waited on.
+    CHECK(!sim.is_registered(10));
+
+    loop.schedule_a(readiness_waiter(stage));
+    loop.run_once(time_type {});
+    CHECK(sim.is_registered(10));
+    CHECK(stage == 0);
+
+    sim.inject(10, selector::events::input);
+    loop.run_once(time_type {});
+    CHECK(stage == 2);
+
+    sim.advance(time_type::from_sec(2));
+    sim.inject(10, selector::events::input);
+    loop.run();
+    CHECK(stage == 3);
+    CHECK(!sim.is_registered(10));
+}
+
+// An fd served without ever waiting costs no registration at all.
+void check_lazy_registration() {
+    simulation sim;
+    event_loop_t loop { sim };
+
+    loop.add_fd(11, file_ops::readable);
+    loop.run_once(time_type {});
+    CHECK(!sim.is_registered(11));
+    loop.del_fd(11);
+    CHECK(sim.get_num_events() == 0);
+}
+
+// An injected error wakes the waiters of both directions.
+task<> error_waiter(int& woken) {
+    co_await get_event_loop().await_write(12);
+    woken++;
+}
+
+void check_error() {
+    simulation sim;
+    event_loop_t loop { sim };
+    int woken = 0;
+
+    loop.add_fd(12, file_ops::readable | file_ops::writable, trigger_mode::level);
+    loop.schedule_a(error_waiter(woken));
+    loop.run_once(time_type {});
+    sim.inject(12, selector::events::error);
+    loop.run_once(time_type {});
+    CHECK(woken == 1);
+    loop.del_fd(12);
+}
+
+// Periodic timers fire at absolute deadlines, and report the ticks skipped
+// while the loop was busy.
+task<> periodic_ticks(simulation& sim) {
+    auto& loop = get_event_loop();
+    periodic_timer timer { 100ms };
+
+    CHECK(co_await timer == 1);
+    CHECK(loop.now().as_ns() == time_type::from_ms(100).as_ns());
+
+    // Busy until 350ms: the ticks at 200 and 300ms are reported together.
+    sim.advance(time_type::from_ms(250));
+    CHECK(co_await timer == 2);
+    CHECK(timer.next().as_ns() == time_type::from_ms(400).as_ns());
+
+    CHECK(co_await timer == 1);
+    CHECK(loop.now().as_ns() == time_type::from_ms(400).as_ns());
+}
+
+void check_periodic_timer() {
+    simulation sim;
+    event_loop_t loop { sim };
+    loop.schedule_a(periodic_ticks(sim));
+    loop.run();
+    CHECK(loop.now().as_ns() == time_type::from_ms(400).as_ns());
+}
+
+// Hooks run at their phase of every iteration, and a throwing one leaves the
+// others active.
+void check_hooks() {
+    simulation sim;
+    event_loop_t loop { sim };
+    int idle = 0, prepare = 0, check = 0;
+
+    loop_hook idle_hook { loop_phase::idle, [](void* n) { ++*static_cast<int*>(n); }, &idle };
+    loop_hook prepare_hook { loop_phase::prepare, [](void* n) { ++*static_cast<int*>(n); }, &prepare };
+    loop_hook check_hook { loop_phase::check, [](void* n) { ++*static_cast<int*>(n); }, &check };
+    loop_hook thrower { loop_phase::check, [](void*) { throw runtime_error("hook"); }, nullptr };
+    prepare_hook.start();
+    check_hook.start();
+
+    loop.run_once(time_type::from_sec(1));
+    CHECK(prepare == 1 && check == 1);
+    CHECK(loop.now().as_ns() == time_type::from_sec(1).as_ns());
+
+    // An active idle hook keeps the loop from waiting.
+    idle_hook.start();
+    loop.run_once(time_type::from_sec(1));
+    CHECK(idle == 1);
+    CHECK(loop.now().as_ns() == time_type::from_sec(1).as_ns());
+    idle_hook.stop();
+
+    thrower.start();
+    bool threw = false;
+    try {
+        loop.run_once(time_type {});
+    } catch (runtime_error const&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(thrower.active() && check_hook.active() && prepare_hook.active());
+
+    thrower.stop();
+    loop.run_once(time_type {});
+    CHECK(check == 4);
+}
+
+// Work posted to a simulated loop runs at its next iteration.
+void check_post() {
+    simulation sim;
+    event_loop_t loop { sim };
+    int ran = 0;
+
+    loop.post([&] { ran++; });
+    loop.run_once(time_type::from_sec(1));
+    CHECK(ran == 1);
+    CHECK(loop.now().as_ns() == time_type {}.as_ns());
+}
+
+int main() {
+    check_readiness();
+    check_lazy_registration();
+    check_error();
+    check_periodic_timer();
+    check_hooks();
+    check_post();
+
+    if (failures) {
+        cerr << failures << " check(s) failed\n";
+        return EXIT_FAILURE;
+    }
+    cout << "simulation: all checks passed\n";
+    return EXIT_SUCCESS;
+}